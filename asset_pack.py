@@ -0,0 +1,304 @@
+#!/usr/bin/python3
+
+# Builds an asset pack out of a directory of images and fonts.
+# Every image is encoded in all formats it fits in and the smallest one
+# (or the fastest one within the size budget) is written to <output>.c,
+# <output>.h gets an index with ASSET_<NAME>_* macros for GUI_ASSET.
+#
+# Usage: asset_pack.py <directory> <output> [--optimize size|speed] [--budget bytes]
+
+import argparse
+import os
+import re
+import sys
+
+import imageio.v3 as iio
+
+# Estimated decode cost in CPU cycles per pixel at scale 1, these are
+# rough guesses which were not measured on the board
+DECODE_COST = {
+    "COLOR_BITMAP": 0,
+    "PALETTE_BITMAP": 5,
+    "BITMAP": 10,
+    "RLE_BITMAP": 12,
+    "RUN_BITMAP": 3,
+}
+
+IMAGE_EXTENSIONS = (".png", ".bmp", ".gif")
+
+
+def pixel_rgb(pixel):
+    # Grayscale images have scalar pixels
+    if not hasattr(pixel, "__len__"):
+        return (int(pixel), int(pixel), int(pixel))
+    return (int(pixel[0]), int(pixel[1]), int(pixel[2]))
+
+
+def lcd_color(rgb):
+    # Same layout as TFT_COLOR, 5 bits per channel and bit 5 unused
+    r, g, b = rgb
+    return ((b >> 3) << 11) | ((g >> 3) << 6) | (r >> 3)
+
+
+def brightness(rgb):
+    return rgb[0] * 299 + rgb[1] * 587 + rgb[2] * 114
+
+
+def encode_bitmap(mask):
+    # 1bpp, packed continuously across rows, MSB first
+    data = []
+    bits = 0
+    count = 8
+    for value in mask:
+        count -= 1
+        if value:
+            bits |= 1 << count
+        if count == 0:
+            data.append(bits)
+            bits = 0
+            count = 8
+    if count != 8:
+        data.append(bits)
+    return data
+
+
+def encode_rle(raw):
+    # 0xFF nn mm repeats mm nn+1 times, a literal 0xFF is 0xFF 0x00 0xFF
+    data = []
+    i = 0
+    while i < len(raw):
+        byte = raw[i]
+        length = 1
+        while i + length < len(raw) and raw[i + length] == byte and length < 256:
+            length += 1
+        if length >= 3 or byte == 0xFF:
+            data += [0xFF, length - 1, byte]
+        else:
+            data += [byte] * length
+        i += length
+    return data
+
+
+def encode_runs(mask):
+    # Alternating background and foreground run lengths, starting with background
+    data = []
+
+    def write_run(length):
+        while length > 0x7FFF:
+            # Split with an empty run of the other color
+            data.extend([0xFF, 0xFF, 0])
+            length -= 0x7FFF
+        if length < 0x80:
+            data.append(length)
+        else:
+            data.extend([0x80 | (length >> 8), length & 0xFF])
+
+    foreground = False
+    length = 0
+    for value in mask:
+        if value != foreground:
+            write_run(length)
+            foreground = not foreground
+            length = 0
+        length += 1
+    write_run(length)
+    return data
+
+
+def encode_palette(pixels, width, height, palette):
+    bpp = next(b for b in (1, 2, 4, 8) if len(palette) <= 1 << b)
+    index = {color: i for i, color in enumerate(palette)}
+    data = []
+    for y in range(height):
+        # Rows are byte padded
+        bits = 0
+        count = 8
+        for x in range(width):
+            count -= bpp
+            bits |= index[pixels[y * width + x]] << count
+            if count == 0:
+                data.append(bits)
+                bits = 0
+                count = 8
+        if count != 8:
+            data.append(bits)
+    return bpp, data
+
+
+def run_cost(mask, width, height):
+    # Rows without a color change are a single DMA fill
+    mixed = 0
+    for y in range(height):
+        row = mask[y * width:(y + 1) * width]
+        if any(row) and not all(row):
+            mixed += 1
+    return mixed * width * DECODE_COST["RUN_BITMAP"]
+
+
+def candidates(pixels, width, height):
+    colors = sorted(set(pixels), key=brightness)
+    result = []
+
+    if len(colors) <= 2:
+        # Brighter color is the foreground, drawn with the element color
+        foreground = colors[-1] if len(colors) == 2 else None
+        mask = [pixel == foreground for pixel in pixels]
+        raw = encode_bitmap(mask)
+        cost = width * height * DECODE_COST["BITMAP"]
+        result.append({"format": "BITMAP", "data": raw, "cost": cost})
+        result.append({"format": "RLE_BITMAP", "data": encode_rle(raw),
+                       "cost": width * height * DECODE_COST["RLE_BITMAP"]})
+        result.append({"format": "RUN_BITMAP", "data": encode_runs(mask),
+                       "cost": run_cost(mask, width, height)})
+
+    if len(colors) <= 256:
+        bpp, data = encode_palette(pixels, width, height, colors)
+        palette = [lcd_color(color) for color in colors]
+        result.append({"format": "PALETTE_BITMAP", "data": data, "bpp": bpp, "palette": palette,
+                       "size": len(data) + len(palette) * 2,
+                       "cost": width * height * DECODE_COST["PALETTE_BITMAP"]})
+
+    words = [lcd_color(pixel) for pixel in pixels]
+    result.append({"format": "COLOR_BITMAP", "words": words, "size": len(words) * 2,
+                   "cost": width * height * DECODE_COST["COLOR_BITMAP"]})
+
+    for candidate in result:
+        candidate.setdefault("size", len(candidate.get("data", [])))
+        candidate.setdefault("bpp", 1)
+    return result
+
+
+def choose(result, optimize, budget):
+    if optimize == "speed":
+        fitting = [c for c in result if budget is None or c["size"] <= budget]
+        if fitting:
+            return min(fitting, key=lambda c: (c["cost"], c["size"]))
+    return min(result, key=lambda c: (c["size"], c["cost"]))
+
+
+def symbol_name(filename):
+    name = re.sub(r"[^0-9a-zA-Z]", "_", os.path.splitext(filename)[0]).lower()
+    if name[0].isdigit():
+        name = "_" + name
+    return name
+
+
+def format_bytes(data):
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append("    " + ", ".join(f"0x{b:02x}" for b in data[i:i + 16]) + ",")
+    return "\n".join(lines)
+
+
+def format_colors(words):
+    lines = []
+    for i in range(0, len(words), 8):
+        lines.append("    " + ", ".join(f"{{ 0x{w:04x} }}" for w in words[i:i + 8]) + ",")
+    return "\n".join(lines)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Build an indexed asset pack")
+    parser.add_argument("directory")
+    parser.add_argument("output", help="Output path without extension")
+    parser.add_argument("--optimize", choices=("size", "speed"), default="size")
+    parser.add_argument("--budget", type=int, default=None, help="Size budget of a single asset in bytes (speed mode)")
+    parser.add_argument("--include", default="lcd/tft_driver.h", help="Driver header included by the pack")
+    args = parser.parse_args()
+
+    pack = os.path.basename(args.output)
+    guard = pack.upper() + "_H"
+    assets = []
+    fonts = []
+
+    for filename in sorted(os.listdir(args.directory)):
+        path = os.path.join(args.directory, filename)
+        name = symbol_name(filename)
+
+        if filename.endswith(".h"):
+            with open(path) as file:
+                match = re.search(r"struct BitmapFont (\w+)", file.read())
+            if match:
+                fonts.append((os.path.abspath(path), match.group(1)))
+                assets.append({"name": name, "format": "TEXT", "width": 0, "height": 0,
+                               "font": match.group(1), "size": 0})
+            continue
+
+        if not filename.lower().endswith(IMAGE_EXTENSIONS):
+            continue
+
+        img = iio.imread(path)
+        height, width = img.shape[0], img.shape[1]
+        pixels = [pixel_rgb(img[y][x]) for y in range(height) for x in range(width)]
+
+        options = candidates(pixels, width, height)
+        chosen = choose(options, args.optimize, args.budget)
+        chosen.update({"name": name, "width": width, "height": height})
+        assets.append(chosen)
+
+        report = ", ".join(f"{c['format']} {c['size']}B" for c in options)
+        print(f"{filename}: {width}x{height} -> {chosen['format']} {chosen['size']}B, "
+              f"~{chosen['cost'] // max(width * height, 1)} cycles/px ({report})", file=sys.stderr)
+
+    with open(args.output + ".c", "w") as out:
+        out.write(f"// Generated by asset_pack.py, do not edit\n\n#include \"{pack}.h\"\n")
+        for path, _ in fonts:
+            out.write(f"#include \"{os.path.relpath(path, os.path.dirname(os.path.abspath(args.output)))}\"\n")
+        out.write("\n")
+
+        for asset in assets:
+            if asset["format"] == "TEXT":
+                continue
+            if asset["format"] == "COLOR_BITMAP":
+                out.write(f"const LcdColor asset_{asset['name']}[] = {{\n{format_colors(asset['words'])}\n}};\n\n")
+            else:
+                out.write(f"const uint8_t asset_{asset['name']}[] = {{\n{format_bytes(asset['data'])}\n}};\n\n")
+            if "palette" in asset:
+                out.write(f"const LcdColor asset_{asset['name']}_palette[] = {{\n{format_colors(asset['palette'])}\n}};\n\n")
+
+        out.write("const LcdAsset asset_pack[ASSET_COUNT] = {\n")
+        for asset in assets:
+            name = "ASSET_" + asset["name"].upper()
+            data = f"&{asset['font']}" if asset["format"] == "TEXT" else f"{name}_DATA"
+            out.write(f"    [ASSET_ID_{asset['name'].upper()}] = {{ {name}_FORMAT, {name}_WIDTH, {name}_HEIGHT, "
+                      f"{data}, {name}_PALETTE, {name}_BPP, {asset['size']} }},\n")
+        out.write("};\n")
+
+    with open(args.output + ".h", "w") as out:
+        out.write(f"// Generated by asset_pack.py, do not edit\n#ifndef {guard}\n#define {guard}\n\n")
+        out.write(f"#include \"{args.include}\"\n\n#ifdef __cplusplus\nextern \"C\" {{\n#endif\n\n")
+
+        for asset in assets:
+            name = "ASSET_" + asset["name"].upper()
+            if asset["format"] == "TEXT":
+                # Defined by the pack, don't include the font header next to it
+                out.write(f"extern const struct BitmapFont {asset['font']};\n")
+            elif asset["format"] == "COLOR_BITMAP":
+                out.write(f"extern const LcdColor asset_{asset['name']}[];\n")
+            else:
+                out.write(f"extern const uint8_t asset_{asset['name']}[];\n")
+            if "palette" in asset:
+                out.write(f"extern const LcdColor asset_{asset['name']}_palette[];\n")
+
+            palette = f"asset_{asset['name']}_palette" if "palette" in asset else "0"
+            data = f"&{asset['font']}" if asset["format"] == "TEXT" else f"asset_{asset['name']}"
+            out.write(f"#define {name}_FORMAT {asset['format']}\n")
+            out.write(f"#define {name}_WIDTH {asset['width']}\n")
+            out.write(f"#define {name}_HEIGHT {asset['height']}\n")
+            out.write(f"#define {name}_DATA {data}\n")
+            out.write(f"#define {name}_PALETTE {palette}\n")
+            out.write(f"#define {name}_BPP {asset['bpp'] if 'bpp' in asset else 1}\n\n")
+
+        out.write("enum AssetId {\n")
+        for asset in assets:
+            out.write(f"    ASSET_ID_{asset['name'].upper()},\n")
+        out.write("    ASSET_COUNT\n};\n\n")
+        out.write("extern const LcdAsset asset_pack[ASSET_COUNT];\n\n")
+        out.write(f"#ifdef __cplusplus\n}}\n#endif\n\n#endif\n")
+
+    total = sum(asset["size"] for asset in assets)
+    print(f"{pack}: {len(assets)} assets, {total} bytes", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -14,6 +14,35 @@ rle = False
 if len(sys.argv) >= 3 and sys.argv[2] == "rle":
     rle = True
 
+def is_foreground(pixel):
+    return pixel[0] == 255 and pixel[1] == 255 and pixel[2] == 255
+
+if len(sys.argv) >= 3 and sys.argv[2] == "runs":
+    # Pixel runs (RUN_BITMAP), alternating background and foreground lengths
+    def write_run(length):
+        while length > 0x7FFF:
+            # Split with an empty run of the other color
+            print(f"0x{0xFF:x}, 0x{0xFF:x}, 0, ", end="")
+            length -= 0x7FFF
+        if length < 0x80:
+            print(f"{length}, ", end="")
+        else:
+            print(f"0x{0x80 | (length >> 8):x}, 0x{length & 0xFF:x}, ", end="")
+
+    foreground = False
+    length = 0
+    for y in range(img.shape[0]):
+        for x in range(img.shape[1]):
+            if is_foreground(img[y][x]) != foreground:
+                write_run(length)
+                foreground = not foreground
+                length = 0
+            length += 1
+
+    write_run(length)
+    print("};")
+    sys.exit(0)
+
 def write_byte(byte):
     global currentByte
     global currentCount
@@ -47,21 +76,22 @@ def write_byte(byte):
 bits = 0
 count = 8
 
-for y in range(img.shape[1]):
-    for x in range(img.shape[0]):
+# Rows are shape[0], columns are shape[1]
+for y in range(img.shape[0]):
+    for x in range(img.shape[1]):
         pixel = img[y][x]
         count -= 1
-        if pixel[0] == 255 and pixel[1] == 255 and pixel[2] == 255:
-            # Foreground
+        if is_foreground(pixel):
             bits |= 1 << count
-            pass
-        else:
-            # Background
-            pass
         if count == 0:
             count = 8
             write_byte(bits)
             bits = 0
 
+# Last partial byte
+if count != 8:
+    write_byte(bits)
+
 write_byte(-1)
 print("};")
+print(f"// {img.shape[1]}x{img.shape[0]}", file=sys.stderr)
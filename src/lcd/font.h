@@ -7,6 +7,13 @@ extern "C" {
 
 #include <stdint.h>
 
+// Font metrics are constexpr in C++ so that text can be measured at compile time
+#ifdef __cplusplus
+#define FONT_DATA constexpr
+#else
+#define FONT_DATA const
+#endif
+
 struct BitmapFontGlyph {
     uint16_t bfg_bitmapOffset;
     uint8_t bfg_width;
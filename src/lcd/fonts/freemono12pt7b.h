@@ -122,7 +122,7 @@ const uint8_t FreeMono12pt7bBitmaps[] = {
   0xC0, 0xFF, 0xFF, 0xC0, 0xC1, 0x08, 0x42, 0x10, 0x84, 0x10, 0x4C, 0x42,
   0x10, 0x84, 0x26, 0x00, 0x38, 0x13, 0x38, 0x38 };
 
-const struct BitmapFontGlyph FreeMono12pt7bGlyphs[] = {
+FONT_DATA struct BitmapFontGlyph FreeMono12pt7bGlyphs[] = {
   {     0,   0,   0,  14,    0,    1 },   // 0x20 ' '
   {     0,   3,  15,  14,    6,  -14 },   // 0x21 '!'
   {     6,   8,   7,  14,    3,  -14 },   // 0x22 '"'
@@ -219,7 +219,7 @@ const struct BitmapFontGlyph FreeMono12pt7bGlyphs[] = {
   {  1444,   5,  18,  14,    5,  -14 },   // 0x7D '}'
   {  1456,  10,   3,  14,    2,   -7 } }; // 0x7E '~'
 
-const struct BitmapFont FreeMono12pt7b = {
+FONT_DATA struct BitmapFont FreeMono12pt7b = {
   (uint8_t*)FreeMono12pt7bBitmaps,
   (struct BitmapFontGlyph*)FreeMono12pt7bGlyphs,
   0x20, 0x7E, 24 };
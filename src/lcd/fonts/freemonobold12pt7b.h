@@ -145,7 +145,7 @@ const uint8_t FreeMonoBold12pt7bBitmaps[] = {
   0x79, 0x83, 0x06, 0x0C, 0x18, 0x31, 0xE3, 0x80, 0x3C, 0x37, 0xE7, 0x67,
   0xE6, 0x1C };
 
-const struct BitmapFontGlyph FreeMonoBold12pt7bGlyphs[] = {
+FONT_DATA struct BitmapFontGlyph FreeMonoBold12pt7bGlyphs[] = {
   {     0,   0,   0,  14,    0,    1 },   // 0x20 ' '
   {     0,   4,  15,  14,    5,  -14 },   // 0x21 '!'
   {     8,   8,   7,  14,    3,  -13 },   // 0x22 '"'
@@ -242,7 +242,7 @@ const struct BitmapFontGlyph FreeMonoBold12pt7bGlyphs[] = {
   {  1707,   7,  19,  14,    4,  -14 },   // 0x7D '}'
   {  1724,  12,   4,  14,    1,   -7 } }; // 0x7E '~'
 
-const struct BitmapFont FreeMonoBold12pt7b = {
+FONT_DATA struct BitmapFont FreeMonoBold12pt7b = {
   (uint8_t*)FreeMonoBold12pt7bBitmaps,
   (struct BitmapFontGlyph*)FreeMonoBold12pt7bGlyphs,
   0x20, 0x7E, 24 };
@@ -165,7 +165,7 @@ const uint8_t FreeSans12pt7bBitmaps[] = {
   0x8C, 0x63, 0x18, 0xC6, 0x73, 0x00, 0x70, 0x3E, 0x09, 0xE4, 0x1F, 0x03,
   0x80 };
 
-const struct BitmapFontGlyph FreeSans12pt7bGlyphs[] = {
+FONT_DATA struct BitmapFontGlyph FreeSans12pt7bGlyphs[] = {
   {     0,   0,   0,   6,    0,    1 },   // 0x20 ' '
   {     0,   2,  18,   8,    3,  -17 },   // 0x21 '!'
   {     5,   6,   6,   8,    1,  -16 },   // 0x22 '"'
@@ -262,7 +262,7 @@ const struct BitmapFontGlyph FreeSans12pt7bGlyphs[] = {
   {  1947,   5,  23,   8,    2,  -17 },   // 0x7D '}'
   {  1962,  10,   5,  12,    1,  -10 } }; // 0x7E '~'
 
-const struct BitmapFont FreeSans12pt7b = {
+FONT_DATA struct BitmapFont FreeSans12pt7b = {
   (uint8_t*)FreeSans12pt7bBitmaps,
   (struct BitmapFontGlyph*)FreeSans12pt7bGlyphs,
   0x20, 0x7E, 29 };
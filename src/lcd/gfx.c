@@ -1,39 +1,58 @@
 #include "gfx.h"
 
+#include <assert.h>
 #include <string.h>
 
 #define ALLOC(type) malloc(sizeof(struct type))
-#define DEF_HANDLE_TYPE(typename) void gfx_handle_##typename(const struct GuiElement* element, Context* context)
+#define DEF_HANDLE_TYPE(typename) void gfx_handle_##typename(struct GuiElement* element, Context* context)
 #define HANDLE_TYPE(typename) case typename: gfx_handle_##typename(element, context); break
-#define BASE_INFO(listentry, optype) \
-    (listentry)->operation.lo_op = (optype); \
-    (listentry)->operation.lo_fg = element->ge_color; \
-    (listentry)->operation.lo_bg = context->c_prevColor; \
-    (listentry)->operation.lo_x = gfx_decode_position(element->ge_x, context) + context->c_x; \
-    (listentry)->operation.lo_y = gfx_decode_position(element->ge_y, context) + context->c_y
+#define BASE_INFO(op, optype) \
+    (op)->lo_op = (optype); \
+    (op)->lo_fg = element->ge_color; \
+    (op)->lo_bg = context->c_prevColor; \
+    (op)->lo_x = gfx_decode_position(element->ge_x, context) + context->c_x; \
+    (op)->lo_y = gfx_decode_position(element->ge_y, context) + context->c_y
+
+// Seven segment readouts
+#define SEGMENT_MINUS 0x40
+#define SEGMENT_DP    0x80
+// Lower digits would have segments without any pixels
+#define READOUT_MIN_HEIGHT 10
 
 size_t gfx_listLength = 0;
+
+// Element of the walked tree which uses the scroll area of the panel
+const struct GuiElement* gfx_scrollUser = 0;
 struct OpListEntry* gfx_list = 0;
 struct OpListEntry* gfx_listLast = 0;
-struct EventListEntry* gfx_buildingEventList = 0;
-struct EventListEntry* gfx_buildingEventListLast = 0;
-
-struct EventListEntry* gfx_eventList = 0;
+// Touch regions of the generated elements are written here (if set)
+GfxTouchIndex* gfx_buildingIndex = 0;
+extern GfxTouchIndex* gfx_touchIndex;
 
 uint8_t gfx_onlyDirty = 0;
 
-struct OpListEntry {
-    struct LcdOperation operation;
-    struct OpListEntry* next;
-};
+typedef enum EmitMode_t {
+    EMIT_LIST,  // Allocate a list entry for every operation
+    EMIT_COUNT, // Only count the operations
+    EMIT_ARRAY  // Write operations into a preallocated array
+} EmitMode;
 
-struct EventListEntry {
-    uint16_t x, y, width, height;
-    callback_t* callback;
+EmitMode gfx_emitMode = EMIT_LIST;
+struct LcdOperation* gfx_emitArray = 0;
+size_t gfx_emitCursor = 0;
+struct LcdOperation gfx_scratchOp;
 
-    const struct GuiElement* element;
+GfxDisplayList* gfx_compilingList = 0;
+size_t gfx_compilingElements = 0;
 
-    struct EventListEntry* next;
+// Full builds store parent links and collect the value elements
+uint8_t gfx_linkElements = 0;
+struct GuiElement* gfx_buildingValues = 0;
+struct GuiElement* gfx_values = 0;
+
+struct OpListEntry {
+    struct LcdOperation operation;
+    struct OpListEntry* next;
 };
 
 typedef struct Context_t {
@@ -48,6 +67,27 @@ typedef struct Context_t {
     uint8_t c_forceRender;
 } Context;
 
+struct GfxDisplayListEntry {
+    struct GuiElement* gdle_element;
+    Context gdle_context;
+
+    size_t gdle_firstOp;
+    size_t gdle_opCount;
+
+    // Index of the first entry after this element's children
+    size_t gdle_subtreeEnd;
+};
+
+typedef struct WalkFrame_t {
+    struct GuiElement* wf_box;
+    struct GuiElement* wf_elements;
+    size_t wf_count;
+    size_t wf_index;
+
+    Context wf_context;
+    struct GfxDisplayListEntry* wf_entry;
+} WalkFrame;
+
 int16_t gfx_decode_position(uint16_t encoded, Context* ctx) {
     int16_t numberPart = encoded & POSITION_NUMBER_PART;
     if(encoded & POSITION_SIGN_BIT) {
@@ -82,43 +122,46 @@ void gfx_insert_op(struct OpListEntry* entry) {
     ++gfx_listLength;
 }
 
-void gfx_insert_ev(struct EventListEntry* entry) {
-    if(!gfx_buildingEventList) {
-        gfx_buildingEventList = entry;
-        gfx_buildingEventListLast = entry;
-    } else {
-        gfx_buildingEventListLast->next = entry;
-        gfx_buildingEventListLast = entry;
+/**
+ * @brief Emit operation
+ * Returns space for the next generated LCD operation,
+ * where it is stored depends on the current emit mode.
+ *
+ * @return struct LcdOperation* Operation to fill in
+ */
+struct LcdOperation* gfx_emit_op() {
+    switch(gfx_emitMode) {
+        case EMIT_COUNT:
+            ++gfx_emitCursor;
+            return &gfx_scratchOp;
+        case EMIT_ARRAY:
+            return gfx_emitArray + gfx_emitCursor++;
+        case EMIT_LIST:
+        default: {
+            struct OpListEntry* entry = ALLOC(OpListEntry);
+            entry->operation.lo_static = 0;
+            entry->operation.lo_queued = 0;
+            gfx_insert_op(entry);
+            return &entry->operation;
+        }
     }
-    entry->next = 0;
 }
 
-void gfx_handle_element(const struct GuiElement* element, Context* context);
+void gfx_box_context(const struct GuiElement* element, Context* context, Context* boxContext) {
+    boxContext->c_x = gfx_decode_position(element->ge_x, context) + context->c_x;
+    boxContext->c_y = gfx_decode_position(element->ge_y, context) + context->c_y;
+    boxContext->c_prevWidth = gfx_decode_position(element->ge_width, context);
+    boxContext->c_prevHeight = gfx_decode_position(element->ge_height, context);
+    boxContext->c_prevColor = element->ge_color;
+    boxContext->c_forceRender = 0;
+}
 
 DEF_HANDLE_TYPE(GFX_BOX) {
-    Context ctx_new;
-
-    ctx_new.c_x = gfx_decode_position(element->ge_x, context) + context->c_x;
-    ctx_new.c_y = gfx_decode_position(element->ge_y, context) + context->c_y;
-    ctx_new.c_prevWidth = gfx_decode_position(element->ge_width, context);
-    ctx_new.c_prevHeight = gfx_decode_position(element->ge_height, context);
-    ctx_new.c_prevColor = element->ge_color;
-    ctx_new.c_forceRender = 0;
-
-    if(!gfx_onlyDirty || element->ge_dirty || context->c_forceRender) {
-        struct OpListEntry* e = ALLOC(OpListEntry);
-
-        BASE_INFO(e, RECT_FILL);
-        e->operation.lo_rect.width = ctx_new.c_prevWidth;
-        e->operation.lo_rect.height = ctx_new.c_prevHeight;
-
-        gfx_insert_op(e);
+    struct LcdOperation* e = gfx_emit_op();
 
-        ctx_new.c_forceRender = 1;
-    }
-
-    for(size_t i = 0; i < element->ge_box.ge_childrenCount; ++i)
-        gfx_handle_element(element->ge_box.ge_children + i, &ctx_new);
+    BASE_INFO(e, RECT_FILL);
+    e->lo_rect.width = gfx_decode_position(element->ge_width, context);
+    e->lo_rect.height = gfx_decode_position(element->ge_height, context);
 }
 
 size_t gfx_text_length(const char* text, const struct BitmapFont* font) {
@@ -134,88 +177,94 @@ size_t gfx_text_length(const char* text, const struct BitmapFont* font) {
     return len;
 }
 
-DEF_HANDLE_TYPE(GFX_TEXT) {
-    struct OpListEntry* e = ALLOC(OpListEntry);
-    BASE_INFO(e, TEXT);
-
-    e->operation.lo_text.value = element->ge_text.ge_text;
-    e->operation.lo_text.font = element->ge_text.ge_font;
-
-    if(element->ge_text.ge_textAlign == ALIGN_CENTER) {
+void gfx_align_text(struct LcdOperation* op, uint8_t align, const struct GuiElement* element, Context* context) {
+    if(align == ALIGN_CENTER) {
         // Calculate text length
-        size_t len = gfx_text_length(element->ge_text.ge_text, element->ge_text.ge_font);
+        size_t len = gfx_text_length(op->lo_text.value, op->lo_text.font);
         size_t width = gfx_decode_position(element->ge_width, context);
 
         if(len < width) {
             // We can center the horizontally
             size_t emptyLen = width - len;
-            e->operation.lo_x += emptyLen / 2;
+            op->lo_x += emptyLen / 2;
         }
-    } else if(element->ge_text.ge_textAlign == ALIGN_RIGHT) {
-        size_t len = gfx_text_length(element->ge_text.ge_text, element->ge_text.ge_font);
+    } else if(align == ALIGN_RIGHT) {
+        size_t len = gfx_text_length(op->lo_text.value, op->lo_text.font);
 
         // Offset text to the left by its length
-        e->operation.lo_x -= len;
+        op->lo_x -= len;
     }
+}
+
+DEF_HANDLE_TYPE(GFX_TEXT) {
+    struct LcdOperation* e = gfx_emit_op();
+    BASE_INFO(e, TEXT);
+
+    e->lo_text.value = element->ge_text.ge_text;
+    e->lo_text.font = element->ge_text.ge_font;
 
-    gfx_insert_op(e);
+    gfx_align_text(e, element->ge_text.ge_textAlign, element, context);
+}
+
+DEF_HANDLE_TYPE(GFX_VALUE) {
+    struct LcdOperation* e = gfx_emit_op();
+    BASE_INFO(e, TEXT);
+
+    // The operation points at the text cached inside of the element,
+    // a newer value rendered before this operation is sent will still
+    // be displayed correctly.
+    e->lo_text.value = element->ge_value.ge_text;
+    e->lo_text.font = element->ge_value.ge_font;
+
+    gfx_align_text(e, element->ge_value.ge_textAlign, element, context);
 }
 
 DEF_HANDLE_TYPE(GFX_BUTTON) {
-    struct OpListEntry* bg = ALLOC(OpListEntry);
+    struct LcdOperation* bg = gfx_emit_op();
 
     BASE_INFO(bg, RECT_FILL);
-    bg->operation.lo_rect.width = gfx_decode_position(element->ge_width, context);
-    bg->operation.lo_rect.height = gfx_decode_position(element->ge_height, context);
-
-    gfx_insert_op(bg);
+    bg->lo_rect.width = gfx_decode_position(element->ge_width, context);
+    bg->lo_rect.height = gfx_decode_position(element->ge_height, context);
 
-    struct OpListEntry* text = ALLOC(OpListEntry);
+    struct LcdOperation* text = gfx_emit_op();
 
     BASE_INFO(text, TEXT);
-    text->operation.lo_bg = element->ge_color;
-    text->operation.lo_fg = element->ge_button.ge_textColor;
+    text->lo_bg = element->ge_color;
+    text->lo_fg = element->ge_button.ge_textColor;
 
-    text->operation.lo_text.value = element->ge_button.ge_text;
-    text->operation.lo_text.font = element->ge_button.ge_font;
+    text->lo_text.value = element->ge_button.ge_text;
+    text->lo_text.font = element->ge_button.ge_font;
 
     if(element->ge_button.ge_textAlign == ALIGN_CENTER) {
         // Calculate text length
         size_t len = gfx_text_length(element->ge_button.ge_text, element->ge_button.ge_font);
 
-        if(len < bg->operation.lo_rect.width) {
+        if(len < bg->lo_rect.width) {
             // We can center the text inside of the container horizontally
-            size_t emptyLen = bg->operation.lo_rect.width - len;
-            text->operation.lo_x += emptyLen / 2;
+            size_t emptyLen = bg->lo_rect.width - len;
+            text->lo_x += emptyLen / 2;
         }
     } else if(element->ge_button.ge_textAlign == ALIGN_RIGHT) {
         size_t len = gfx_text_length(element->ge_button.ge_text, element->ge_button.ge_font);
 
         // Offset text to the left by its length
-        text->operation.lo_x = bg->operation.lo_x + bg->operation.lo_rect.width - len;
+        text->lo_x = bg->lo_x + bg->lo_rect.width - len;
     }
 
-    if(element->ge_button.ge_font->bf_yAdvance < bg->operation.lo_rect.height) {
+    if(element->ge_button.ge_font->bf_yAdvance < bg->lo_rect.height) {
         // We can center text inside of the container vertically
-        size_t emptyHeight = bg->operation.lo_rect.height - element->ge_button.ge_font->bf_yAdvance;
-        text->operation.lo_y += emptyHeight / 2;
+        size_t emptyHeight = bg->lo_rect.height - element->ge_button.ge_font->bf_yAdvance;
+        text->lo_y += emptyHeight / 2;
     }
 
-    // Create the event list entry
-    if(element->ge_button.ge_clickCallback != 0 && !gfx_onlyDirty) {
-        struct EventListEntry* evEn = ALLOC(EventListEntry);
-
-        evEn->x = bg->operation.lo_x;
-        evEn->y = bg->operation.lo_y;
-        evEn->width = bg->operation.lo_rect.width;
-        evEn->height = bg->operation.lo_rect.height;
-        evEn->callback = element->ge_button.ge_clickCallback;
-        evEn->element = element;
-
-        gfx_insert_ev(evEn);
+    // Add (or move) the touch region
+    if(gfx_buildingIndex) {
+        GfxHitRegion region = {
+            bg->lo_x, bg->lo_y, bg->lo_rect.width, bg->lo_rect.height,
+            text->lo_x, text->lo_y,
+            element->ge_button.ge_clickCallback, element };
+        gfx_touch_index_set(gfx_buildingIndex, element, &region);
     }
-
-    gfx_insert_op(text);
 }
 
 DEF_HANDLE_TYPE(GFX_BORDER) {
@@ -224,45 +273,41 @@ DEF_HANDLE_TYPE(GFX_BORDER) {
     size_t w = gfx_decode_position(element->ge_width, context);
     size_t h = gfx_decode_position(element->ge_height, context);
 
-    struct OpListEntry* top = ALLOC(OpListEntry);
-    top->operation.lo_op = RECT_FILL;
-    top->operation.lo_fg = element->ge_color;
-    top->operation.lo_x = x;
-    top->operation.lo_y = y;
-    top->operation.lo_rect.width = w;
-    top->operation.lo_rect.height = element->ge_border.ge_borderThickness;
-    gfx_insert_op(top);
-
-    struct OpListEntry* bottom = ALLOC(OpListEntry);
-    bottom->operation.lo_op = RECT_FILL;
-    bottom->operation.lo_fg = element->ge_color;
-    bottom->operation.lo_x = x;
-    bottom->operation.lo_y = y + h - element->ge_border.ge_borderThickness;
-    bottom->operation.lo_rect.width = w;
-    bottom->operation.lo_rect.height = element->ge_border.ge_borderThickness;
-    gfx_insert_op(bottom);
-
-    struct OpListEntry* left = ALLOC(OpListEntry);
-    left->operation.lo_op = RECT_FILL;
-    left->operation.lo_fg = element->ge_color;
-    left->operation.lo_x = x;
-    left->operation.lo_y = y;
-    left->operation.lo_rect.width = element->ge_border.ge_borderThickness;
-    left->operation.lo_rect.height = h;
-    gfx_insert_op(left);
-
-    struct OpListEntry* right = ALLOC(OpListEntry);
-    right->operation.lo_op = RECT_FILL;
-    right->operation.lo_fg = element->ge_color;
-    right->operation.lo_x = x + w - element->ge_border.ge_borderThickness;
-    right->operation.lo_y = y;
-    right->operation.lo_rect.width = element->ge_border.ge_borderThickness;
-    right->operation.lo_rect.height = h;
-    gfx_insert_op(right);
+    struct LcdOperation* top = gfx_emit_op();
+    top->lo_op = RECT_FILL;
+    top->lo_fg = element->ge_color;
+    top->lo_x = x;
+    top->lo_y = y;
+    top->lo_rect.width = w;
+    top->lo_rect.height = element->ge_border.ge_borderThickness;
+
+    struct LcdOperation* bottom = gfx_emit_op();
+    bottom->lo_op = RECT_FILL;
+    bottom->lo_fg = element->ge_color;
+    bottom->lo_x = x;
+    bottom->lo_y = y + h - element->ge_border.ge_borderThickness;
+    bottom->lo_rect.width = w;
+    bottom->lo_rect.height = element->ge_border.ge_borderThickness;
+
+    struct LcdOperation* left = gfx_emit_op();
+    left->lo_op = RECT_FILL;
+    left->lo_fg = element->ge_color;
+    left->lo_x = x;
+    left->lo_y = y;
+    left->lo_rect.width = element->ge_border.ge_borderThickness;
+    left->lo_rect.height = h;
+
+    struct LcdOperation* right = gfx_emit_op();
+    right->lo_op = RECT_FILL;
+    right->lo_fg = element->ge_color;
+    right->lo_x = x + w - element->ge_border.ge_borderThickness;
+    right->lo_y = y;
+    right->lo_rect.width = element->ge_border.ge_borderThickness;
+    right->lo_rect.height = h;
 }
 
 DEF_HANDLE_TYPE(GFX_IMAGE_BUTTON) {
-    struct OpListEntry* bitmapOp = ALLOC(OpListEntry);
+    struct LcdOperation* bitmapOp = gfx_emit_op();
 
     LcdOperationEnum op = BITMAP;
     if(element->ge_img_button.ge_rle)
@@ -272,115 +317,957 @@ DEF_HANDLE_TYPE(GFX_IMAGE_BUTTON) {
     size_t height = gfx_decode_position(element->ge_height, context);
 
     BASE_INFO(bitmapOp, op);
-    bitmapOp->operation.lo_bitmap.bitmap = element->ge_img_button.ge_bitmap;
-    bitmapOp->operation.lo_bitmap.width = width / element->ge_img_button.ge_imageScale;
-    bitmapOp->operation.lo_bitmap.height = height / element->ge_img_button.ge_imageScale;
-    bitmapOp->operation.lo_bitmap.scale = element->ge_img_button.ge_imageScale;
-
-    bitmapOp->operation.lo_fg = element->ge_img_button.ge_fgColor;
-    bitmapOp->operation.lo_bg = element->ge_color;
-    gfx_insert_op(bitmapOp);
-
-    // Create the event list entry
-    if(element->ge_img_button.ge_clickCallback != 0 && !gfx_onlyDirty) {
-        struct EventListEntry* evEn = ALLOC(EventListEntry);
-
-        evEn->x = bitmapOp->operation.lo_x;
-        evEn->y = bitmapOp->operation.lo_y;
-        evEn->width = width;
-        evEn->height = height;
-        evEn->callback = element->ge_img_button.ge_clickCallback;
-        evEn->element = element;
-
-        gfx_insert_ev(evEn);
+    bitmapOp->lo_bitmap.bitmap = element->ge_img_button.ge_bitmap;
+    bitmapOp->lo_bitmap.width = width / element->ge_img_button.ge_imageScale;
+    bitmapOp->lo_bitmap.height = height / element->ge_img_button.ge_imageScale;
+    bitmapOp->lo_bitmap.scale = element->ge_img_button.ge_imageScale;
+
+    bitmapOp->lo_fg = element->ge_img_button.ge_fgColor;
+    bitmapOp->lo_bg = element->ge_color;
+
+    // Add (or move) the touch region
+    if(gfx_buildingIndex) {
+        GfxHitRegion region = {
+            bitmapOp->lo_x, bitmapOp->lo_y, width, height,
+            bitmapOp->lo_x, bitmapOp->lo_y,
+            element->ge_img_button.ge_clickCallback, element };
+        gfx_touch_index_set(gfx_buildingIndex, element, &region);
     }
 }
 
-void gfx_handle_element(const struct GuiElement* element, Context* context) {
-    if(!gfx_onlyDirty || element->ge_dirty || element->ge_type == GFX_BOX || context->c_forceRender) {
-        switch(element->ge_type) {
-            HANDLE_TYPE(GFX_BOX);
-            HANDLE_TYPE(GFX_TEXT);
-            HANDLE_TYPE(GFX_BUTTON);
-            HANDLE_TYPE(GFX_BORDER);
-            HANDLE_TYPE(GFX_IMAGE_BUTTON);
+DEF_HANDLE_TYPE(GFX_IMAGE) {
+    struct LcdOperation* bitmapOp = gfx_emit_op();
+
+    uint8_t scale = element->ge_image.ge_imageScale ? element->ge_image.ge_imageScale : 1;
+
+    BASE_INFO(bitmapOp, element->ge_image.ge_format);
+    bitmapOp->lo_bitmap.bitmap = element->ge_image.ge_bitmap;
+    bitmapOp->lo_bitmap.width = gfx_decode_position(element->ge_width, context) / scale;
+    bitmapOp->lo_bitmap.height = gfx_decode_position(element->ge_height, context) / scale;
+    bitmapOp->lo_bitmap.scale = scale;
+    bitmapOp->lo_bitmap.palette = element->ge_image.ge_palette;
+    bitmapOp->lo_bitmap.bpp = element->ge_image.ge_bpp;
+}
+
+DEF_HANDLE_TYPE(GFX_GRADIENT) {
+    struct LcdOperation* e = gfx_emit_op();
+
+    BASE_INFO(e, element->ge_gradient.ge_direction == GRADIENT_HORIZONTAL ? HGRADIENT_FILL : VGRADIENT_FILL);
+    e->lo_bg = element->ge_gradient.ge_toColor;
+    e->lo_gradient.width = gfx_decode_position(element->ge_width, context);
+    e->lo_gradient.height = gfx_decode_position(element->ge_height, context);
+    e->lo_gradient.length = 0;
+    e->lo_gradient.offset = 0;
+}
+
+DEF_HANDLE_TYPE(GFX_SHAPE) {
+    struct LcdOperation* e = gfx_emit_op();
+
+    BASE_INFO(e, element->ge_shape.ge_kind);
+    e->lo_shape.width = gfx_decode_position(element->ge_width, context);
+    e->lo_shape.height = gfx_decode_position(element->ge_height, context);
+    e->lo_shape.x0 = element->ge_shape.ge_x0;
+    e->lo_shape.y0 = element->ge_shape.ge_y0;
+    e->lo_shape.x1 = element->ge_shape.ge_x1;
+    e->lo_shape.y1 = element->ge_shape.ge_y1;
+    e->lo_shape.radius = element->ge_shape.ge_radius;
+    e->lo_shape.thickness = element->ge_shape.ge_thickness;
+    e->lo_shape.run = 0;
+    e->lo_shape.row = 0;
+}
+
+// The panel has a single scroll area, only one element of a tree can use it
+void gfx_claim_scroll(const struct GuiElement* element) {
+    assert(!gfx_scrollUser || gfx_scrollUser == element);
+    gfx_scrollUser = element;
+}
+
+DEF_HANDLE_TYPE(GFX_PLOT) {
+    struct LcdOperation* e = gfx_emit_op();
+    GfxPlot* state = element->ge_plot.ge_state;
+    LcdPlot* plot = &state->gp_plot;
+
+    BASE_INFO(e, PLOT);
+    plot->lp_width = gfx_decode_position(element->ge_width, context);
+    plot->lp_height = gfx_decode_position(element->ge_height, context);
+    e->lo_plot.width = plot->lp_width;
+    e->lo_plot.height = plot->lp_height;
+    e->lo_plot.plot = plot;
+    e->lo_plot.first = 0;
+    e->lo_plot.top = plot->lp_head;
+
+    // Scrolling moves whole panel rows, every row of the box holds a sample.
+    // Sweep plots have a column for every sample after the axis.
+    if(plot->lp_flags & PLOT_SCROLL) {
+        assert(e->lo_x == 0 && plot->lp_width == TFT_WIDTH && plot->lp_capacity == plot->lp_height);
+        gfx_claim_scroll(element);
+    } else
+        assert(plot->lp_capacity < plot->lp_width);
+
+    // Samples are read when the operation is rendered, this draws all of them
+    state->gp_pending = 0;
+    state->gp_x = e->lo_x;
+    state->gp_y = e->lo_y;
+    state->gp_traceColor = e->lo_fg;
+    state->gp_background = e->lo_bg;
+    state->gp_visible = 1;
+}
+
+// Segments a to g (bits 0 to 6) of the digits 0 to 9
+const uint8_t gfx_digitSegments[10] = { 0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, 0x7F, 0x6F };
+
+uint16_t gfx_segment_thickness(uint16_t height) {
+    return height >= 16 ? height / 8 : 2;
+}
+
+uint16_t gfx_readout_advance(uint16_t height) {
+    return height / 2 + 2 * gfx_segment_thickness(height);
+}
+
+/**
+ * @brief Create segment operation
+ * Fills in the rectangle of a segment, the segments don't overlap
+ * (corners are left empty) so every one can be redrawn on its own.
+ *
+ * @param op Operation to fill in
+ * @param height Digit height
+ * @param x Left edge of the digit
+ * @param y Top edge of the digit
+ * @param segment Segment a to g (0 to 6) or the decimal point (7)
+ */
+void gfx_segment_op(struct LcdOperation* op, uint16_t height, uint16_t x, uint16_t y, uint8_t segment) {
+    const uint16_t t = gfx_segment_thickness(height);
+    const uint16_t w = height / 2;
+    const uint16_t mid = (height - t) / 2;
+
+    // Horizontal segments (a, g, d) by default
+    uint16_t sx = t;
+    uint16_t sy = 0;
+    uint16_t sw = w - 2 * t;
+    uint16_t sh = t;
+    switch(segment) {
+        case 1: sx = w - t; sy = t; sw = t; sh = mid - t; break;
+        case 2: sx = w - t; sy = mid + t; sw = t; sh = height - 2 * t - mid; break;
+        case 3: sy = height - t; break;
+        case 4: sx = 0; sy = mid + t; sw = t; sh = height - 2 * t - mid; break;
+        case 5: sx = 0; sy = t; sw = t; sh = mid - t; break;
+        case 6: sy = mid; break;
+        case 7: sx = w + t / 2; sy = height - t; sw = t; break;
+    }
+
+    op->lo_op = RECT_FILL;
+    op->lo_x = x + sx;
+    op->lo_y = y + sy;
+    op->lo_rect.width = sw;
+    op->lo_rect.height = sh;
+}
+
+/**
+ * @brief Get readout segments
+ * Formats the bound value into the segments of every cell, the value
+ * is aligned to the right and values which don't fit are shown as dashes.
+ *
+ * @param element Readout element
+ * @param cells Output segments, one byte per cell
+ */
+void gfx_readout_cells(const struct GuiElement* element, uint8_t* cells) {
+    char text[GFX_VALUE_MAX_LENGTH];
+    gfx_format_value(text, *element->ge_readout.ge_source, 0, element->ge_readout.ge_decimals, element->ge_readout.ge_flags);
+
+    uint8_t segments[GFX_VALUE_MAX_LENGTH];
+    size_t count = 0;
+    for(const char* c = text; *c; ++c) {
+        if(*c == '.') {
+            // The point belongs to the digit before it
+            if(count)
+                segments[count - 1] |= SEGMENT_DP;
+        } else if(*c >= '0' && *c <= '9') {
+            segments[count++] = gfx_digitSegments[*c - '0'];
+        } else {
+            segments[count++] = *c == '-' ? SEGMENT_MINUS : 0;
+        }
+    }
+
+    size_t digits = element->ge_readout.ge_digits;
+    if(digits > GFX_READOUT_MAX_DIGITS)
+        digits = GFX_READOUT_MAX_DIGITS;
+    if(count > digits) {
+        memset(cells, SEGMENT_MINUS, digits);
+        return;
+    }
+    memset(cells, 0, digits - count);
+    memcpy(cells + digits - count, segments, count);
+}
+
+DEF_HANDLE_TYPE(GFX_READOUT) {
+    uint16_t height = gfx_decode_position(element->ge_height, context);
+    if(height < READOUT_MIN_HEIGHT)
+        height = READOUT_MIN_HEIGHT;
+    const uint16_t advance = gfx_readout_advance(height);
+    size_t digits = element->ge_readout.ge_digits;
+    if(digits > GFX_READOUT_MAX_DIGITS)
+        digits = GFX_READOUT_MAX_DIGITS;
+
+    uint8_t cells[GFX_READOUT_MAX_DIGITS];
+    gfx_readout_cells(element, cells);
+
+    struct LcdOperation* bg = gfx_emit_op();
+    BASE_INFO(bg, RECT_FILL);
+    bg->lo_fg = context->c_prevColor;
+    bg->lo_rect.width = digits * advance;
+    bg->lo_rect.height = height;
+
+    // Segments which are off are drawn too, so the number of operations never changes
+    for(size_t i = 0; i < digits; ++i) {
+        for(uint8_t segment = 0; segment < GFX_READOUT_SEGMENTS; ++segment) {
+            struct LcdOperation* e = gfx_emit_op();
+            BASE_INFO(e, RECT_FILL);
+            gfx_segment_op(e, height, bg->lo_x + i * advance, bg->lo_y, segment);
+            if(!(cells[i] & (1 << segment)))
+                e->lo_fg = element->ge_readout.ge_offColor;
         }
     }
+
+    // Count pass must not modify the elements
+    if(gfx_emitMode != EMIT_COUNT) {
+        memcpy(element->ge_readout.ge_cells, cells, digits);
+        element->ge_readout.ge_screenX = bg->lo_x;
+        element->ge_readout.ge_screenY = bg->lo_y;
+        element->ge_readout.ge_digitHeight = height;
+        element->ge_readout.ge_drawn = 1;
+    }
 }
 
-GfxRenderChain gfx_make_chain(const struct GuiElement* elements, size_t element_count) {
-    // Create a base context
+size_t gfx_update_readout(struct GuiElement* readout) {
+    if(!readout->ge_readout.ge_drawn)
+        return 0;
+
+    size_t digits = readout->ge_readout.ge_digits;
+    if(digits > GFX_READOUT_MAX_DIGITS)
+        digits = GFX_READOUT_MAX_DIGITS;
+
+    uint8_t cells[GFX_READOUT_MAX_DIGITS];
+    gfx_readout_cells(readout, cells);
+
+    const uint16_t height = readout->ge_readout.ge_digitHeight;
+    const uint16_t advance = gfx_readout_advance(height);
+    size_t ops = 0;
+    for(size_t i = 0; i < digits; ++i) {
+        const uint8_t drawn = readout->ge_readout.ge_cells[i];
+        const uint8_t changed = cells[i] ^ drawn;
+        for(uint8_t segment = 0; segment < GFX_READOUT_SEGMENTS; ++segment) {
+            const uint8_t bit = 1 << segment;
+            if(!(changed & bit))
+                continue;
+
+            struct LcdOperation* op = readout->ge_readout.ge_state->gr_ops + i * GFX_READOUT_SEGMENTS + segment;
+            if(tft_operation_busy(op)) {
+                // Keep the drawn state, the change is picked up by a later update
+                cells[i] = (cells[i] & ~bit) | (drawn & bit);
+                continue;
+            }
+
+            gfx_segment_op(op, height, readout->ge_readout.ge_screenX + i * advance, readout->ge_readout.ge_screenY, segment);
+            op->lo_fg = cells[i] & bit ? readout->ge_color : readout->ge_readout.ge_offColor;
+            op->lo_static = 1;
+            tft_submit(op);
+            ++ops;
+        }
+    }
+
+    memcpy(readout->ge_readout.ge_cells, cells, digits);
+    if(ops)
+        tft_start_render();
+    return ops;
+}
+
+void gfx_list_touched(const void* element);
+
+DEF_HANDLE_TYPE(GFX_LIST) {
+    struct LcdOperation* e = gfx_emit_op();
+    GfxList* list = element->ge_list.ge_state;
+
+    // Only the background is drawn here, the rows are drawn by the next flush
+    BASE_INFO(e, RECT_FILL);
+    e->lo_rect.width = gfx_decode_position(element->ge_width, context);
+    e->lo_rect.height = gfx_decode_position(element->ge_height, context);
+
+    list->gl_x = e->lo_x;
+    list->gl_y = e->lo_y;
+    list->gl_width = e->lo_rect.width;
+    list->gl_height = e->lo_rect.height;
+    list->gl_background = element->ge_color;
+    list->gl_drawn = 0;
+    list->gl_visible = 1;
+    if(list->gl_x == 0 && list->gl_width == TFT_WIDTH)
+        gfx_claim_scroll(element);
+
+    if(gfx_buildingIndex) {
+        GfxHitRegion region = {
+            e->lo_x, e->lo_y, e->lo_rect.width, e->lo_rect.height,
+            e->lo_x, e->lo_y,
+            gfx_list_touched, element };
+        gfx_touch_index_set(gfx_buildingIndex, element, &region);
+    }
+}
+
+void gfx_plot_push(GfxPlot* plot, int16_t value) {
+    LcdPlot* samples = &plot->gp_plot;
+    samples->lp_samples[samples->lp_head] = value;
+    samples->lp_head = (samples->lp_head + 1) % samples->lp_capacity;
+    if(samples->lp_count < samples->lp_capacity)
+        ++samples->lp_count;
+    if(plot->gp_pending < samples->lp_capacity)
+        ++plot->gp_pending;
+
+    gfx_plot_flush(plot);
+}
+
+size_t gfx_plot_flush(GfxPlot* plot) {
+    const LcdPlot* samples = &plot->gp_plot;
+    if(!plot->gp_pending || !plot->gp_visible)
+        return 0;
+
+    // New samples, the gap after them and the oldest sample (which lost
+    // its connection to the erased one), a full ring is redrawn from the start
+    const size_t capacity = samples->lp_capacity;
+    size_t start = 0;
+    size_t length = capacity;
+    if(plot->gp_pending + 2u < capacity) {
+        start = (samples->lp_head + capacity - plot->gp_pending) % capacity;
+        length = plot->gp_pending + 2;
+    }
+
+    // Ranges going over the end of the ring are split in two
+    const size_t needed = start + length > capacity ? 2 : 1;
+    struct LcdOperation* ops[2];
+    size_t found = 0;
+    for(size_t i = 0; i < GFX_PLOT_SLOTS && found < needed; ++i) {
+        if(!tft_operation_busy(&plot->gp_ops[i]))
+            ops[found++] = &plot->gp_ops[i];
+    }
+    if(found < needed)
+        return 0;
+
+    const uint8_t scroll = samples->lp_flags & PLOT_SCROLL;
+    // Samples which don't fit into the box are never drawn
+    const size_t visible = scroll ? samples->lp_height : (samples->lp_width ? samples->lp_width - 1u : 0);
+    size_t submitted = 0;
+    for(size_t i = 0; i < needed; ++i) {
+        const size_t first = i ? 0 : start;
+        size_t count = needed == 1 ? length : (i ? start + length - capacity : capacity - start);
+        if(first >= visible)
+            continue;
+        if(first + count > visible)
+            count = visible - first;
+
+        struct LcdOperation* op = ops[i];
+        op->lo_op = PLOT;
+        op->lo_fg = plot->gp_traceColor;
+        op->lo_bg = plot->gp_background;
+        op->lo_static = 1;
+        op->lo_plot.plot = samples;
+        op->lo_plot.top = samples->lp_head;
+        if(scroll) {
+            op->lo_x = plot->gp_x;
+            op->lo_y = plot->gp_y + first;
+            op->lo_plot.width = samples->lp_width;
+            op->lo_plot.height = count;
+            op->lo_plot.first = first;
+        } else {
+            // Sample columns start after the axis
+            op->lo_x = plot->gp_x + first + 1;
+            op->lo_y = plot->gp_y;
+            op->lo_plot.width = count;
+            op->lo_plot.height = samples->lp_height;
+            op->lo_plot.first = first + 1;
+        }
+        tft_submit(op);
+        ++submitted;
+    }
+
+    plot->gp_pending = 0;
+    tft_start_render();
+    return submitted;
+}
+
+size_t gfx_format_value(char* buffer, int32_t value, uint8_t minWidth, uint8_t decimals, uint8_t flags) {
+    char digits[GFX_VALUE_MAX_LENGTH];
+    size_t count = 0;
+
+    if(decimals > VALUE_MAX_DECIMALS)
+        decimals = VALUE_MAX_DECIMALS;
+    if(minWidth > GFX_VALUE_MAX_LENGTH - 1)
+        minWidth = GFX_VALUE_MAX_LENGTH - 1;
+
+    // Negating as unsigned also handles INT32_MIN
+    uint32_t magnitude = value < 0 ? -(uint32_t)value : (uint32_t)value;
+
+    // Produce the digits in reverse order, there is always
+    // at least one digit in front of the decimal point.
+    do {
+        if(decimals && count == decimals)
+            digits[count++] = '.';
+        digits[count++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while(magnitude || count <= decimals);
+
+    char sign = 0;
+    if(value < 0)
+        sign = '-';
+    else if(flags & VALUE_SIGN_ALWAYS)
+        sign = '+';
+    else if(flags & VALUE_SIGN_SPACE)
+        sign = ' ';
+
+    size_t length = count + (sign ? 1 : 0);
+    size_t padding = minWidth > length ? minWidth - length : 0;
+
+    char* out = buffer;
+    if(flags & VALUE_PAD_ZERO) {
+        if(sign)
+            *out++ = sign;
+        for(size_t i = 0; i < padding; ++i)
+            *out++ = '0';
+    } else {
+        for(size_t i = 0; i < padding; ++i)
+            *out++ = ' ';
+        if(sign)
+            *out++ = sign;
+    }
+
+    while(count)
+        *out++ = digits[--count];
+    *out = 0;
+
+    return out - buffer;
+}
+
+/**
+ * @brief Refresh a value element
+ * Formats the bound value and stores it in the element.
+ *
+ * @return uint8_t 1 if the displayed text has changed
+ */
+uint8_t gfx_refresh_value(struct GuiElement* element) {
+    char text[GFX_VALUE_MAX_LENGTH];
+    gfx_format_value(text, *element->ge_value.ge_source, element->ge_value.ge_minWidth, element->ge_value.ge_decimals, element->ge_value.ge_flags);
+
+    if(!strcmp(text, element->ge_value.ge_text))
+        return 0;
+
+    strcpy(element->ge_value.ge_text, text);
+    return 1;
+}
+
+void gfx_mark_dirty(struct GuiElement* element) {
+    element->ge_dirty |= GFX_DIRTY;
+
+    // If a parent already has the flag then so do all of its ancestors
+    for(struct GuiElement* parent = element->ge_parent; parent && !(parent->ge_dirty & GFX_SUBTREE_DIRTY); parent = parent->ge_parent)
+        parent->ge_dirty |= GFX_SUBTREE_DIRTY;
+}
+
+/**
+ * @brief Poll value elements
+ * Formats all bound values and marks the elements whose text
+ * has changed as dirty, readouts redraw their changed segments.
+ *
+ * @param values First value element of the list
+ */
+void gfx_poll_values(struct GuiElement* values) {
+    struct GuiElement* next;
+    for(struct GuiElement* value = values; value; value = next) {
+        if(value->ge_type == GFX_READOUT) {
+            // Readouts draw the changed segments right away
+            next = value->ge_readout.ge_nextValue;
+            gfx_update_readout(value);
+        } else {
+            next = value->ge_value.ge_nextValue;
+            if(gfx_refresh_value(value))
+                gfx_mark_dirty(value);
+        }
+    }
+}
+
+/**
+ * @brief Walk element tree
+ * Generates operations for the elements and their children, in update
+ * mode subtrees without any dirty elements are skipped entirely.
+ * The traversal is iterative, it uses a fixed size stack of GFX_MAX_DEPTH
+ * frames, the walk stops at a box nested deeper than that.
+ *
+ * @param elements Elements to walk
+ * @param count Number of elements
+ * @param context Context of the elements
+ * @return uint8_t 0 if the boxes are nested too deep
+ */
+uint8_t gfx_walk(struct GuiElement* elements, size_t count, Context* context) {
+    gfx_scrollUser = 0;
+
+    WalkFrame stack[GFX_MAX_DEPTH];
+    size_t depth = 0;
+
+    stack[0].wf_box = 0;
+    stack[0].wf_elements = elements;
+    stack[0].wf_count = count;
+    stack[0].wf_index = 0;
+    stack[0].wf_context = *context;
+    stack[0].wf_entry = 0;
+
+    // Count pass must not modify the elements
+    uint8_t clearFlags = gfx_emitMode != EMIT_COUNT;
+
+    for(;;) {
+        WalkFrame* frame = stack + depth;
+
+        if(frame->wf_index == frame->wf_count) {
+            // All children of the box have been visited
+            if(frame->wf_entry) {
+                frame->wf_entry->gdle_opCount = gfx_emitCursor - frame->wf_entry->gdle_firstOp;
+                frame->wf_entry->gdle_subtreeEnd = gfx_compilingList->gdl_entryCount;
+            }
+
+            if(depth == 0)
+                return 1;
+            --depth;
+            continue;
+        }
+
+        struct GuiElement* element = frame->wf_elements + frame->wf_index++;
+        context = &frame->wf_context;
+
+        if(gfx_linkElements) {
+            element->ge_parent = frame->wf_box;
+            if(element->ge_type == GFX_VALUE) {
+                element->ge_value.ge_nextValue = gfx_buildingValues;
+                gfx_buildingValues = element;
+            } else if(element->ge_type == GFX_READOUT) {
+                element->ge_readout.ge_nextValue = gfx_buildingValues;
+                gfx_buildingValues = element;
+            }
+        }
+
+        uint8_t render = !gfx_onlyDirty || (element->ge_dirty & GFX_DIRTY) || context->c_forceRender;
+        if(!render && !(element->ge_dirty & GFX_SUBTREE_DIRTY)) {
+            // Nothing has changed in here
+            continue;
+        }
+
+        struct GfxDisplayListEntry* entry = 0;
+        if(render) {
+            if(gfx_emitMode == EMIT_COUNT) {
+                ++gfx_compilingElements;
+            } else if(gfx_compilingList) {
+                // Remember where the operations of this element are
+                entry = gfx_compilingList->gdl_entries + gfx_compilingList->gdl_entryCount++;
+                entry->gdle_element = element;
+                entry->gdle_context = *context;
+                entry->gdle_firstOp = gfx_emitCursor;
+            }
+
+            if(element->ge_type == GFX_VALUE)
+                gfx_refresh_value(element);
+
+            switch(element->ge_type) {
+                HANDLE_TYPE(GFX_BOX);
+                HANDLE_TYPE(GFX_TEXT);
+                HANDLE_TYPE(GFX_BUTTON);
+                HANDLE_TYPE(GFX_BORDER);
+                HANDLE_TYPE(GFX_IMAGE_BUTTON);
+                HANDLE_TYPE(GFX_VALUE);
+                HANDLE_TYPE(GFX_IMAGE);
+                HANDLE_TYPE(GFX_GRADIENT);
+                HANDLE_TYPE(GFX_SHAPE);
+                HANDLE_TYPE(GFX_PLOT);
+                HANDLE_TYPE(GFX_LIST);
+                HANDLE_TYPE(GFX_READOUT);
+            }
+
+            if(clearFlags)
+                element->ge_dirty &= ~GFX_DIRTY;
+        }
+
+        if(element->ge_type == GFX_BOX) {
+            // Trees nested deeper than GFX_MAX_DEPTH need a larger stack
+            if(depth + 1 >= GFX_MAX_DEPTH)
+                return 0;
+
+            WalkFrame* child = stack + ++depth;
+            child->wf_box = element;
+            // Only constexpr trees of gfx_static.hpp need const children, they are never walked
+            child->wf_elements = (struct GuiElement*)element->ge_box.ge_children;
+            child->wf_count = element->ge_box.ge_childrenCount;
+            child->wf_index = 0;
+            child->wf_entry = entry;
+            gfx_box_context(element, context, &child->wf_context);
+            // Children of a rendered box have to be rendered as well
+            child->wf_context.c_forceRender = render;
+
+            if(clearFlags)
+                element->ge_dirty &= ~GFX_SUBTREE_DIRTY;
+        } else if(entry) {
+            entry->gdle_opCount = gfx_emitCursor - entry->gdle_firstOp;
+            entry->gdle_subtreeEnd = gfx_compilingList->gdl_entryCount;
+        }
+    }
+}
+
+Context gfx_base_context() {
     Context ctx;
     ctx.c_x = 0;
     ctx.c_y = 0;
     ctx.c_prevWidth = TFT_WIDTH;
     ctx.c_prevHeight = TFT_HEIGHT;
     ctx.c_prevColor = TFT_BLACK;
+    ctx.c_forceRender = 0;
+    return ctx;
+}
+
+GfxRenderChain gfx_make_chain(struct GuiElement* elements, size_t element_count) {
+    // Create a base context
+    Context ctx = gfx_base_context();
 
-    for(size_t i = 0; i < element_count; ++i)
-        gfx_handle_element(elements + i, &ctx);
+    const uint8_t complete = gfx_walk(elements, element_count, &ctx);
 
     // Collect the list into an array
-    struct LcdOperation* ops = malloc(sizeof(struct LcdOperation) * gfx_listLength);
+    struct LcdOperation* ops = complete ? malloc(sizeof(struct LcdOperation) * gfx_listLength) : 0;
     size_t index = 0;
 
     struct OpListEntry* entry = gfx_list;
     while(entry) {
         struct OpListEntry* next = entry->next;
-        memcpy(ops + index, &entry->operation, sizeof(struct LcdOperation));
+        if(ops)
+            memcpy(ops + index, &entry->operation, sizeof(struct LcdOperation));
         free(entry);
 
         entry = next;
         ++index;
     }
 
+    // Incomplete chains have neither operations nor a touch index
     GfxRenderChain result;
-    result.grc_length = gfx_listLength;
+    result.grc_length = complete ? gfx_listLength : 0;
     result.grc_operations = ops;
-    result.grc_eventList = gfx_buildingEventList;
+    result.grc_eventList = complete ? gfx_buildingIndex : 0;
 
     gfx_list = 0;
     gfx_listLast = 0;
     gfx_listLength = 0;
-    gfx_buildingEventList = 0;
-    gfx_buildingEventListLast = 0;
+    gfx_buildingIndex = 0;
 
     return result;
 }
 
-GfxRenderChain gfx_create_render_chain(const struct GuiElement* elements, size_t elementCount) {
+GfxRenderChain gfx_create_render_chain(struct GuiElement* elements, size_t elementCount) {
+    GfxTouchIndex* index = gfx_create_touch_index();
     gfx_onlyDirty = 0;
-    return gfx_make_chain(elements, elementCount);
+    gfx_buildingIndex = index;
+    gfx_linkElements = 1;
+    gfx_buildingValues = 0;
+
+    GfxRenderChain chain = gfx_make_chain(elements, elementCount);
+    if(!chain.grc_eventList) {
+        gfx_delete_touch_index(index);
+        gfx_buildingValues = 0;
+    }
+
+    gfx_values = gfx_buildingValues;
+    gfx_linkElements = 0;
+    return chain;
 }
 
-GfxRenderChain gfx_create_update_chain(const struct GuiElement* elements, size_t elementCount) {
+GfxRenderChain gfx_create_update_chain(struct GuiElement* elements, size_t elementCount) {
+    gfx_poll_values(gfx_values);
+
+    // Moved elements update the active touch index, the returned chain doesn't own it
     gfx_onlyDirty = 1;
-    return gfx_make_chain(elements, elementCount);
+    gfx_buildingIndex = gfx_touchIndex;
+    GfxRenderChain chain = gfx_make_chain(elements, elementCount);
+    chain.grc_eventList = 0;
+    return chain;
 }
 
 void gfx_delete_render_chain(GfxRenderChain chain) {
     free(chain.grc_operations);
+    gfx_delete_touch_index(chain.grc_eventList);
+}
 
-    struct EventListEntry* event = chain.grc_eventList;
-    if(gfx_eventList == event)
-        gfx_eventList = 0;
+/**
+ * @brief Chain completion marker
+ * Called by the driver once the last operation of the chain has been sent,
+ * releases the reference held by the render queue.
+ */
+void gfx_chain_rendered(void* arg) {
+    GfxChainHandle* handle = arg;
+    handle->gch_done = 1;
+
+    if(handle->gch_callback)
+        handle->gch_callback(handle, handle->gch_arg);
+    gfx_chain_release(handle);
+}
 
-    while(event) {
-        struct EventListEntry* next = event->next;
-        free(event);
-        event = next;
+GfxChainHandle* gfx_submit_chain(GfxRenderChain chain, gfx_chain_callback_t* callback, void* arg) {
+    GfxChainHandle* handle = malloc(sizeof(GfxChainHandle));
+    handle->gch_chain = chain;
+    handle->gch_callback = callback;
+    handle->gch_arg = arg;
+    handle->gch_done = 0;
+    // One reference for the caller and one for the render queue
+    handle->gch_refs = 2;
+
+    handle->gch_marker.lo_op = CALLBACK;
+    handle->gch_marker.lo_static = 1;
+    handle->gch_marker.lo_queued = 0;
+    handle->gch_marker.lo_callback.function = &gfx_chain_rendered;
+    handle->gch_marker.lo_callback.arg = handle;
+
+    tft_submit_multiple(chain.grc_operations, chain.grc_length);
+    tft_submit(&handle->gch_marker);
+    tft_start_render();
+
+    return handle;
+}
+
+void gfx_chain_retain(GfxChainHandle* handle) {
+    __atomic_add_fetch(&handle->gch_refs, 1, __ATOMIC_RELAXED);
+}
+
+void gfx_chain_release(GfxChainHandle* handle) {
+    if(!handle || __atomic_sub_fetch(&handle->gch_refs, 1, __ATOMIC_ACQ_REL))
+        return;
+
+    gfx_delete_render_chain(handle->gch_chain);
+    free(handle);
+}
+
+GfxDisplayList gfx_compile_display_list(struct GuiElement* elements, size_t elementCount) {
+    GfxDisplayList list;
+    Context ctx = gfx_base_context();
+
+    gfx_onlyDirty = 0;
+    gfx_buildingIndex = 0;
+
+    // First pass, count the operations and elements
+    gfx_emitMode = EMIT_COUNT;
+    gfx_emitCursor = 0;
+    gfx_compilingElements = 0;
+    if(!gfx_walk(elements, elementCount, &ctx)) {
+        memset(&list, 0, sizeof(GfxDisplayList));
+        gfx_emitMode = EMIT_LIST;
+        return list;
+    }
+
+    list.gdl_length = gfx_emitCursor;
+    list.gdl_operations = calloc(list.gdl_length, sizeof(struct LcdOperation));
+    list.gdl_entryCount = 0;
+    list.gdl_entries = malloc(sizeof(struct GfxDisplayListEntry) * gfx_compilingElements);
+
+    // Second pass, fill in the operations and remember where they came from
+    gfx_emitMode = EMIT_ARRAY;
+    gfx_emitArray = list.gdl_operations;
+    gfx_emitCursor = 0;
+    gfx_compilingList = &list;
+    gfx_buildingIndex = gfx_create_touch_index();
+    gfx_linkElements = 1;
+    gfx_buildingValues = 0;
+    gfx_walk(elements, elementCount, &ctx);
+
+    for(size_t i = 0; i < list.gdl_length; ++i)
+        list.gdl_operations[i].lo_static = 1;
+
+    list.gdl_eventList = gfx_buildingIndex;
+    list.gdl_values = gfx_buildingValues;
+    gfx_linkElements = 0;
+    gfx_compilingList = 0;
+    gfx_buildingIndex = 0;
+    gfx_emitMode = EMIT_LIST;
+
+    return list;
+}
+
+/**
+ * @brief Cancel display list entry
+ * Takes the queued operations of an element out of the render queue,
+ * they are stale and are going to be regenerated.
+ *
+ * @param list Display list
+ * @param entry Element entry
+ * @param cancelled Incremented for every removed operation (can be 0)
+ * @return uint8_t 0 if one of the operations is being rendered right now
+ */
+uint8_t gfx_cancel_entry(GfxDisplayList* list, struct GfxDisplayListEntry* entry, uint16_t* cancelled) {
+    uint8_t result = 1;
+    for(size_t i = 0; i < entry->gdle_opCount; ++i) {
+        int state = tft_cancel(list->gdl_operations + entry->gdle_firstOp + i);
+        if(state < 0)
+            result = 0;
+        else if(state > 0 && cancelled)
+            ++*cancelled;
+    }
+    return result;
+}
+
+/**
+ * @brief Patch display list entry
+ * Regenerates the operations of an element (and all of its children)
+ * in place and submits them to the render queue. Queued operations
+ * are taken out of the queue first, so they are never modified while
+ * the driver can see them. If one of them is being rendered right now
+ * the patch is deferred, the element is left dirty for the next update.
+ *
+ * @param list Display list
+ * @param index Index of the element entry
+ * @param submit Submit the regenerated operations
+ * @return uint8_t 0 if the patch was deferred
+ */
+uint8_t gfx_patch_entry(GfxDisplayList* list, size_t index, uint8_t submit) {
+    struct GfxDisplayListEntry* entry = list->gdl_entries + index;
+    Context ctx = entry->gdle_context;
+
+    if(!gfx_cancel_entry(list, entry, 0)) {
+        // Try again in the next update, this also flags the parents again
+        gfx_mark_dirty(entry->gdle_element);
+        return 0;
+    }
+
+    gfx_onlyDirty = 0;
+    gfx_buildingIndex = list->gdl_eventList;
+    gfx_emitMode = EMIT_ARRAY;
+    gfx_emitArray = list->gdl_operations;
+    gfx_emitCursor = entry->gdle_firstOp;
+
+    gfx_walk(entry->gdle_element, 1, &ctx);
+
+    gfx_emitMode = EMIT_LIST;
+    gfx_buildingIndex = 0;
+
+    if(submit)
+        tft_submit_multiple(list->gdl_operations + entry->gdle_firstOp, entry->gdle_opCount);
+    return 1;
+}
+
+void gfx_display_list_submit(GfxDisplayList* list) {
+    tft_submit_multiple(list->gdl_operations, list->gdl_length);
+}
+
+uint8_t gfx_display_list_update(GfxDisplayList* list, struct GuiElement* element) {
+    for(size_t i = 0; i < list->gdl_entryCount; ++i) {
+        if(list->gdl_entries[i].gdle_element == element)
+            return gfx_patch_entry(list, i, 1);
+    }
+    return 1;
+}
+
+/**
+ * @brief Patch dirty display list entries
+ *
+ * @param list Display list
+ * @param scheduler Scheduler which collects statistics (can be 0)
+ * @param submit Submit the patched operations
+ * @return size_t Number of patched elements
+ */
+size_t gfx_patch_dirty(GfxDisplayList* list, GfxScheduler* scheduler, uint8_t submit) {
+    size_t patched = 0;
+    gfx_poll_values(list->gdl_values);
+
+    size_t i = 0;
+    while(i < list->gdl_entryCount) {
+        struct GfxDisplayListEntry* entry = list->gdl_entries + i;
+        struct GuiElement* element = entry->gdle_element;
+
+        if(element->ge_dirty & GFX_DIRTY) {
+            if(scheduler && !gfx_cancel_entry(list, entry, &scheduler->gs_cancelledOps)) {
+                // Try again in the next frame, this also flags the parents again
+                gfx_mark_dirty(element);
+                ++scheduler->gs_deferred;
+            } else if(gfx_patch_entry(list, i, submit)) {
+                ++patched;
+            }
+            i = entry->gdle_subtreeEnd;
+        } else if(element->ge_dirty & GFX_SUBTREE_DIRTY) {
+            // Look at the children
+            element->ge_dirty &= ~GFX_SUBTREE_DIRTY;
+            ++i;
+        } else {
+            // Skip the whole subtree
+            i = entry->gdle_subtreeEnd;
+        }
     }
+
+    return patched;
 }
 
-void gfx_activate_event_list(void* eventList) {
-    gfx_eventList = eventList;
+void gfx_display_list_update_dirty(GfxDisplayList* list) {
+    gfx_patch_dirty(list, 0, 1);
 }
 
-void tft_touch_cb(uint16_t x, uint16_t y) {
-    for(struct EventListEntry* en = gfx_eventList; en; en = en->next) {
-        if(x >= en->x && y >= en->y && x < en->x + en->width && y < en->y + en->height) {
-            en->callback(en->element);
-            break;
+size_t gfx_display_list_refresh(GfxDisplayList* list) {
+    return gfx_patch_dirty(list, 0, 0);
+}
+
+void gfx_display_list_hide(GfxDisplayList* list) {
+    // Queued operations would be drawn over whatever is shown next
+    for(size_t i = 0; i < list->gdl_length; ++i)
+        tft_cancel(list->gdl_operations + i);
+
+    // Elements which draw on their own stop until they are rendered again
+    for(size_t i = 0; i < list->gdl_entryCount; ++i) {
+        struct GuiElement* element = list->gdl_entries[i].gdle_element;
+        switch(element->ge_type) {
+            case GFX_PLOT:
+                element->ge_plot.ge_state->gp_visible = 0;
+                break;
+            case GFX_LIST:
+                element->ge_list.ge_state->gl_visible = 0;
+                break;
+            case GFX_READOUT:
+                element->ge_readout.ge_drawn = 0;
+                for(size_t j = 0; j < GFX_READOUT_MAX_DIGITS * GFX_READOUT_SEGMENTS; ++j)
+                    tft_cancel(element->ge_readout.ge_state->gr_ops + j);
+                break;
+            default:
+                continue;
         }
+        gfx_mark_dirty(element);
     }
 }
+
+size_t gfx_display_list_size(const GfxDisplayList* list) {
+    return sizeof(struct LcdOperation) * list->gdl_length +
+           sizeof(struct GfxDisplayListEntry) * list->gdl_entryCount +
+           gfx_touch_index_size(list->gdl_eventList);
+}
+
+void gfx_scheduler_init(GfxScheduler* scheduler, GfxDisplayList* list, uint16_t maxFps) {
+    memset(scheduler, 0, sizeof(GfxScheduler));
+    scheduler->gs_list = list;
+    scheduler->gs_frameTime = maxFps ? 1000 / maxFps : 0;
+}
+
+void gfx_scheduler_invalidate(GfxScheduler* scheduler, struct GuiElement* element) {
+    (void)scheduler;
+    // Repeated invalidations only set the same flag again
+    gfx_mark_dirty(element);
+}
+
+size_t gfx_scheduler_poll(GfxScheduler* scheduler, uint32_t now) {
+    if(scheduler->gs_frames && now - scheduler->gs_lastFrame < scheduler->gs_frameTime)
+        return 0;
+
+    size_t patched = gfx_patch_dirty(scheduler->gs_list, scheduler, 1);
+    if(!patched)
+        return 0;
+
+    tft_start_render();
+
+    scheduler->gs_lastFrame = now;
+    ++scheduler->gs_frames;
+    return patched;
+}
+
+void gfx_delete_display_list(GfxDisplayList list) {
+    free(list.gdl_operations);
+    free(list.gdl_entries);
+    gfx_delete_touch_index(list.gdl_eventList);
+}
@@ -12,7 +12,14 @@ typedef enum GuiElementType_t {
     GFX_BUTTON,
     GFX_TEXT,
     GFX_BORDER,
-    GFX_IMAGE_BUTTON
+    GFX_IMAGE_BUTTON,
+    GFX_VALUE,
+    GFX_IMAGE,
+    GFX_GRADIENT,
+    GFX_SHAPE,
+    GFX_PLOT,
+    GFX_LIST,
+    GFX_READOUT
 } GuiElementType;
 
 typedef void callback_t(const void* element);
@@ -31,6 +38,137 @@ typedef void callback_t(const void* element);
 #define ALIGN_CENTER  1
 #define ALIGN_RIGHT   2
 
+#define GRADIENT_VERTICAL   0
+#define GRADIENT_HORIZONTAL 1
+
+#define VALUE_SIGN_NEGATIVE 0x00
+#define VALUE_SIGN_ALWAYS   0x01
+#define VALUE_SIGN_SPACE    0x02
+#define VALUE_PAD_ZERO      0x04
+
+#define VALUE_MAX_DECIMALS 9
+#define GFX_VALUE_MAX_LENGTH 16
+
+#define GFX_DIRTY         0x01
+#define GFX_SUBTREE_DIRTY 0x02
+
+// Maximum nesting of boxes, deeper trees can't be built
+#ifndef GFX_MAX_DEPTH
+#define GFX_MAX_DEPTH 16
+#endif
+
+// Operations a plot can have in flight when samples are pushed
+#ifndef GFX_PLOT_SLOTS
+#define GFX_PLOT_SLOTS 4
+#endif
+
+// Cells of a seven segment readout (digits, sign and blanks)
+#ifndef GFX_READOUT_MAX_DIGITS
+#define GFX_READOUT_MAX_DIGITS 10
+#endif
+
+// Segments of a readout cell (seven segments and the decimal point)
+#define GFX_READOUT_SEGMENTS 8
+
+// Operations a list row callback can emit
+#ifndef GFX_LIST_ROW_OPS
+#define GFX_LIST_ROW_OPS 4
+#endif
+
+// Distance a touch has to move before a list is dragged instead of tapped
+#ifndef GFX_LIST_DRAG_THRESHOLD
+#define GFX_LIST_DRAG_THRESHOLD 8
+#endif
+
+// Time constant of the list inertia decay in milliseconds
+#ifndef GFX_LIST_FRICTION_MS
+#define GFX_LIST_FRICTION_MS 325
+#endif
+
+// Size of a touch index grid cell in pixels
+#ifndef GFX_TOUCH_CELL_SIZE
+#define GFX_TOUCH_CELL_SIZE 40
+#endif
+
+// Maximum number of screens registered in a screen manager
+#ifndef GFX_MAX_SCREENS
+#define GFX_MAX_SCREENS 8
+#endif
+
+// Plot state, has to be placed in RAM, use GUI_PLOT_STATE to create it
+typedef struct GfxPlot_t {
+    LcdPlot gp_plot;
+    // Samples pushed since the plot was last drawn
+    uint16_t gp_pending;
+    // Set when the plot element is rendered
+    uint16_t gp_x;
+    uint16_t gp_y;
+    LcdColor gp_traceColor;
+    LcdColor gp_background;
+    // Cleared when the screen of the plot is hidden
+    uint8_t gp_visible;
+    struct LcdOperation gp_ops[GFX_PLOT_SLOTS];
+} GfxPlot;
+
+// Readout state, has to be placed in RAM (zero initialized)
+typedef struct GfxReadout_t {
+    // One operation for every segment, redrawn when the segment changes
+    struct LcdOperation gr_ops[GFX_READOUT_MAX_DIGITS * GFX_READOUT_SEGMENTS];
+} GfxReadout;
+
+struct GfxList_t;
+
+/**
+ * Fills in the operations which draw a list row (at most `capacity`,
+ * which is GFX_LIST_ROW_OPS), positioned relative to the top left corner
+ * of the row. The row background is already filled, so text should be
+ * drawn with the list background. Returns the number of operations.
+ */
+typedef size_t gfx_row_callback_t(const struct GfxList_t* list, uint32_t row, struct LcdOperation* ops, size_t capacity);
+typedef void gfx_row_tap_t(struct GfxList_t* list, uint32_t row);
+
+// List state, has to be placed in RAM, use GUI_LIST_STATE to create it
+typedef struct GfxList_t {
+    uint32_t gl_rowCount;
+    uint16_t gl_rowHeight;
+    gfx_row_callback_t* gl_renderRow;
+    // Called when a row is tapped (touched without dragging), can be null
+    gfx_row_tap_t* gl_rowTap;
+    void* gl_arg;
+
+    // Scroll position in pixels and the position which is on the screen
+    int32_t gl_offset;
+    int32_t gl_drawnOffset;
+    uint8_t gl_drawn;
+
+    // Touch drag and inertia, the velocity is in pixels per second
+    uint8_t gl_dragging;
+    uint8_t gl_moved;
+    uint16_t gl_dragY;
+    int32_t gl_dragOffset;
+    int32_t gl_velocity;
+    int32_t gl_fraction;
+    int32_t gl_pollOffset;
+    uint32_t gl_pollTick;
+
+    // Set when the list element is rendered
+    uint16_t gl_x;
+    uint16_t gl_y;
+    uint16_t gl_width;
+    uint16_t gl_height;
+    LcdColor gl_background;
+    // Cleared when the screen of the list is hidden
+    uint8_t gl_visible;
+
+    // Operations of the rows which are being drawn
+    size_t gl_poolRows;
+    struct LcdOperation* gl_members;
+    struct LcdOperation* gl_composites;
+    struct LcdOperation gl_scrollOp;
+    struct LcdOperation gl_doneOp;
+    volatile uint8_t gl_inFlight;
+} GfxList;
+
 struct GuiElement {
     GuiElementType ge_type;
 
@@ -74,24 +212,671 @@ struct GuiElement {
             uint8_t ge_rle;
             uint8_t ge_imageScale;
         } ge_img_button;
+        /* Image */
+        struct {
+            const void* ge_bitmap;
+            // Bitmap operation used to draw the image (e.g. COLOR_BITMAP)
+            LcdOperationEnum ge_format;
+            uint8_t ge_imageScale;
+            // Only used by PALETTE_BITMAP images
+            const LcdColor* ge_palette;
+            uint8_t ge_bpp;
+        } ge_image;
+        struct {
+            // Gradient goes from ge_color to this color
+            LcdColor ge_toColor;
+            uint8_t ge_direction;
+        } ge_gradient;
+        struct {
+            // LINE, CIRCLE, ARC or ROUND_RECT
+            LcdOperationEnum ge_kind;
+            // Same meaning as in the lo_shape operation
+            int16_t ge_x0;
+            int16_t ge_y0;
+            int16_t ge_x1;
+            int16_t ge_y1;
+            uint16_t ge_radius;
+            uint8_t ge_thickness;
+        } ge_shape;
+        struct {
+            GfxPlot* ge_state;
+        } ge_plot;
+        struct {
+            GfxList* ge_state;
+        } ge_list;
+        /* Readout */
+        struct {
+            const int32_t* ge_source;
+            GfxReadout* ge_state;
+            // Color of the segments which are off
+            LcdColor ge_offColor;
+            uint8_t ge_digits;
+            uint8_t ge_decimals;
+            uint8_t ge_flags;
+            // Segments of every cell and the position they were drawn at
+            uint8_t ge_cells[GFX_READOUT_MAX_DIGITS];
+            uint16_t ge_screenX;
+            uint16_t ge_screenY;
+            uint16_t ge_digitHeight;
+            uint8_t ge_drawn;
+            struct GuiElement* ge_nextValue;
+        } ge_readout;
+        /* Value */
+        struct {
+            const int32_t* ge_source;
+            const struct BitmapFont* ge_font;
+            uint8_t ge_minWidth;
+            uint8_t ge_decimals;
+            uint8_t ge_flags;
+            uint8_t ge_textAlign;
+            char ge_text[GFX_VALUE_MAX_LENGTH];
+            struct GuiElement* ge_nextValue;
+        } ge_value;
     };
 
+    // GFX_DIRTY and GFX_SUBTREE_DIRTY flags, use gfx_mark_dirty()
     uint8_t ge_dirty;
+    // Set by the library when a full render chain or display list is built
+    struct GuiElement* ge_parent;
 };
 
 typedef struct GfxRenderChain_t {
     struct LcdOperation* grc_operations;
     size_t grc_length;
+    // Touch index (GfxTouchIndex) of the chain
     void* grc_eventList;
 } GfxRenderChain;
 
-extern GfxRenderChain gfx_create_render_chain(const struct GuiElement* elements, size_t elementCount);
-extern GfxRenderChain gfx_create_update_chain(const struct GuiElement* elements, size_t elementCount);
+typedef struct GfxOverdrawStats_t {
+    // Pixels sent before and after the pass
+    uint32_t gos_pixelsBefore;
+    uint32_t gos_pixelsAfter;
+    // Pixels which are actually visible at the end
+    uint32_t gos_visiblePixels;
+
+    // Sent pixels per visible pixel in percent (100 means no overdraw)
+    uint16_t gos_ratioBefore;
+    uint16_t gos_ratioAfter;
+} GfxOverdrawStats;
+
+typedef struct GfxOptimizeStats_t {
+    uint16_t gop_opsBefore;
+    uint16_t gop_opsAfter;
+    // Operations removed because they were completely covered
+    uint16_t gop_dropped;
+    // Operations removed by merging fills
+    uint16_t gop_merged;
+
+    // Switches between fill and buffer DMA transfers
+    uint16_t gop_modeSwitchesBefore;
+    uint16_t gop_modeSwitchesAfter;
+    // Column and page address commands needed for all windows
+    uint16_t gop_windowCommandsBefore;
+    uint16_t gop_windowCommandsAfter;
+} GfxOptimizeStats;
+
+typedef struct GfxCompositeStats_t {
+    uint16_t gcs_opsBefore;
+    // Composite operations and the operations drawn by them
+    uint16_t gcs_composites;
+    uint16_t gcs_composited;
+
+    // Pixels sent in direct mode and with compositing
+    uint32_t gcs_pixelsDirect;
+    uint32_t gcs_pixelsComposite;
+} GfxCompositeStats;
+
+typedef struct GfxHitRegion_t {
+    uint16_t ghr_x;
+    uint16_t ghr_y;
+    uint16_t ghr_width;
+    uint16_t ghr_height;
+    // Position of the button text (or image), used for the pressed state
+    uint16_t ghr_contentX;
+    uint16_t ghr_contentY;
+    callback_t* ghr_callback;
+    const struct GuiElement* ghr_element;
+} GfxHitRegion;
+
+typedef struct GfxTouchIndex_t {
+    // Region slots, free slots have no callback
+    GfxHitRegion* gti_regions;
+    size_t gti_capacity;
+    size_t gti_count;
+
+    // Uniform grid over the screen, every cell has a bitmap
+    // of the region slots which overlap it
+    uint32_t* gti_cells;
+} GfxTouchIndex;
+
+struct GfxDisplayListEntry;
+
+typedef struct GfxDisplayList_t {
+    struct LcdOperation* gdl_operations;
+    size_t gdl_length;
+    struct GfxDisplayListEntry* gdl_entries;
+    size_t gdl_entryCount;
+    void* gdl_eventList;
+    struct GuiElement* gdl_values;
+} GfxDisplayList;
+
+struct GfxChainHandle_t;
+typedef void gfx_chain_callback_t(struct GfxChainHandle_t* handle, void* arg);
+
+typedef struct GfxChainHandle_t {
+    GfxRenderChain gch_chain;
+    uint32_t gch_refs;
+
+    gfx_chain_callback_t* gch_callback;
+    void* gch_arg;
+    // Set once the last operation of the chain has been sent
+    volatile uint8_t gch_done;
+
+    // Queued after the chain, tells us when it has been rendered
+    struct LcdOperation gch_marker;
+} GfxChainHandle;
+
+typedef struct GfxScheduler_t {
+    GfxDisplayList* gs_list;
+
+    // Minimum time between two frames in milliseconds
+    uint32_t gs_frameTime;
+    uint32_t gs_lastFrame;
+
+    // Flushed frames
+    uint32_t gs_frames;
+    // Stale operations taken out of the queue before they were rendered
+    uint16_t gs_cancelledOps;
+    // Elements moved to the next frame because they were being rendered
+    uint16_t gs_deferred;
+} GfxScheduler;
+
+typedef struct GfxScreen_t {
+    struct GuiElement* gsc_elements;
+    size_t gsc_count;
+
+    // Cached display list, only valid if the screen is built
+    GfxDisplayList gsc_list;
+    size_t gsc_size;
+    uint8_t gsc_built;
+    // Value of the manager clock when the screen was last shown
+    uint32_t gsc_lastUsed;
+} GfxScreen;
+
+typedef struct GfxScreenManager_t {
+    GfxScreen gsm_screens[GFX_MAX_SCREENS];
+    size_t gsm_count;
 
+    // Memory used by the cached screens and its limit in bytes
+    size_t gsm_budget;
+    size_t gsm_used;
+    uint32_t gsm_clock;
+
+    // Index of the shown screen, -1 if none is shown
+    int8_t gsm_active;
+    // Resets hardware scrolling left by the previous screen
+    struct LcdOperation gsm_scrollOp;
+} GfxScreenManager;
+
+/**
+ * @brief Create render chain
+ * Creates operations for all of the elements. This also links every
+ * element to its parent, so the element trees have to be writable.
+ *
+ * @param elements Root elements
+ * @param elementCount Number of root elements
+ * @return GfxRenderChain Render chain, if boxes are nested deeper than
+ *                        GFX_MAX_DEPTH it is empty and has no touch index
+ */
+extern GfxRenderChain gfx_create_render_chain(struct GuiElement* elements, size_t elementCount);
+
+/**
+ * @brief Create update chain
+ * Creates operations only for dirty elements (and value elements whose
+ * text has changed), subtrees without any changes are not visited.
+ * Dirty flags are cleared once the chain is built.
+ *
+ * @param elements Root elements
+ * @param elementCount Number of root elements
+ * @return GfxRenderChain Render chain, empty if boxes are nested too deep
+ */
+extern GfxRenderChain gfx_create_update_chain(struct GuiElement* elements, size_t elementCount);
+
+/**
+ * @brief Mark element as dirty
+ * Marks the element for re-rendering and flags all of its ancestors,
+ * so that updates can skip subtrees which haven't changed.
+ * Parent links are set up by gfx_create_render_chain()
+ * and gfx_compile_display_list().
+ *
+ * @param element Changed element
+ */
+extern void gfx_mark_dirty(struct GuiElement* element);
+
+/**
+ * @brief Activate event list
+ * Makes the touch index of a render chain or display list the active one.
+ * Update chains and display list updates keep the active index in sync
+ * when buttons move, appear or lose their callback. Pressed buttons
+ * are redrawn with swapped colors through the priority render lane
+ * until the touch panel is released.
+ *
+ * @param eventList Touch index (grc_eventList or gdl_eventList)
+ */
 extern void gfx_activate_event_list(void* eventList);
 
+/**
+ * @brief Activate hit table
+ * Makes a constant table of touch regions the active one (instead of an
+ * event list), this is used by screens built at compile time.
+ *
+ * @param regions Array of touch regions
+ * @param count Length of the array
+ */
+extern void gfx_activate_hit_table(const GfxHitRegion* regions, size_t count);
+
 extern void gfx_delete_render_chain(GfxRenderChain chain);
 
+/**
+ * @brief Submit render chain
+ * Takes ownership of the chain and queues it for rendering (a render is
+ * started if none is running), chains can be queued back to back. The
+ * chain is freed automatically once the handle is released and the last
+ * operation has been sent, so a queued chain can't be freed too early.
+ *
+ * @param chain Render chain, can't be used directly after this call
+ * @param callback Called from the DMA interrupt when the chain is rendered (can be 0)
+ * @param arg Argument passed to the callback
+ * @return GfxChainHandle* Handle holding one reference for the caller
+ */
+extern GfxChainHandle* gfx_submit_chain(GfxRenderChain chain, gfx_chain_callback_t* callback, void* arg);
+
+extern void gfx_chain_retain(GfxChainHandle* handle);
+
+/**
+ * @brief Release chain handle
+ * Drops a reference, the chain and its touch index are freed with the last one.
+ *
+ * @param handle Chain handle (can be 0)
+ */
+extern void gfx_chain_release(GfxChainHandle* handle);
+
+/**
+ * @brief Activate chain touch index
+ * Makes the touch index of the chain the active one, the active chain
+ * holds a reference until another event list or hit table is activated.
+ *
+ * @param handle Chain handle
+ */
+extern void gfx_chain_activate(GfxChainHandle* handle);
+
+/**
+ * @brief Create touch index
+ * Creates an empty spatial index of touch regions. The screen is divided
+ * into a grid of GFX_TOUCH_CELL_SIZE cells, so a lookup only looks at
+ * the few regions overlapping the touched cell.
+ *
+ * @return GfxTouchIndex* Touch index
+ */
+extern GfxTouchIndex* gfx_create_touch_index();
+
+extern void gfx_delete_touch_index(GfxTouchIndex* index);
+
+/**
+ * @brief Set touch region of element
+ * Adds, moves or removes (when callback is 0) the touch region of an element.
+ * Only adding a region past the current capacity allocates memory.
+ *
+ * @param index Touch index
+ * @param element Element which owns the region
+ * @param region Region, ghr_element is ignored
+ */
+extern void gfx_touch_index_set(GfxTouchIndex* index, struct GuiElement* element, const GfxHitRegion* region);
+
+/**
+ * @brief Find touch region
+ * When regions overlap the one in the lowest slot is returned. Slots of
+ * removed regions are reused, so this is the region added first only
+ * as long as no region has been removed.
+ *
+ * @param index Touch index
+ * @param x Touch X position
+ * @param y Touch Y position
+ * @return const GfxHitRegion* Region containing the point or 0
+ */
+extern const GfxHitRegion* gfx_touch_index_find(const GfxTouchIndex* index, uint16_t x, uint16_t y);
+
+/**
+ * @brief Get touch index size
+ *
+ * @param index Touch index (can be null)
+ * @return size_t Heap memory used by the index in bytes
+ */
+extern size_t gfx_touch_index_size(const GfxTouchIndex* index);
+
+/**
+ * @brief Eliminate overdraw
+ * Removes the parts of RECT_FILL operations which are covered by later
+ * opaque operations (fills, text and bitmaps), fills are split into
+ * the rectangles that remain visible. Has to be called before the chain
+ * is submitted, the operation array is replaced.
+ *
+ * @param chain Render chain
+ * @return GfxOverdrawStats Pixel counts before and after
+ */
+extern GfxOverdrawStats gfx_eliminate_overdraw(GfxRenderChain* chain);
+
+/**
+ * @brief Optimise render chain
+ * Drops operations which are completely overwritten later in the chain,
+ * merges fills of the same color which together form a rectangle and
+ * reorders operations that don't overlap, so that consecutive operations
+ * use the same DMA mode and share window columns or rows. Overlapping
+ * operations are never reordered. Has to be called before the chain
+ * is submitted, the operation array is replaced.
+ *
+ * @param chain Render chain
+ * @return GfxOptimizeStats Number of removed operations and switches
+ */
+extern GfxOptimizeStats gfx_optimize_chain(GfxRenderChain* chain);
+
+/**
+ * @brief Composite render chain
+ * Switches the chain to the compositing render mode. Every operation that
+ * is followed by operations lying inside of its area (like a box and its
+ * children) becomes a composite, it is drawn in RAM one buffer sized band
+ * at a time and every pixel of the area is sent once, no matter how many
+ * operations overlap it. Text and shapes inside of a composite only draw
+ * their foreground, so they can be placed over gradients and images.
+ * Has to be the last pass run on the chain before it is submitted, the
+ * operation array is replaced.
+ *
+ * @param chain Render chain
+ * @return GfxCompositeStats Pixels sent in the direct and compositing mode
+ */
+extern GfxCompositeStats gfx_composite_chain(GfxRenderChain* chain);
+
+/**
+ * @brief Compile display list
+ * Builds a persistent list of LCD operations for the given element tree
+ * together with a map of which operations belong to which element.
+ * This is the only step of the retained mode that allocates memory,
+ * updating the list afterwards never touches the heap.
+ *
+ * @param elements Root elements
+ * @param elementCount Number of root elements
+ * @return GfxDisplayList Compiled display list, if boxes are nested deeper
+ *                        than GFX_MAX_DEPTH it is empty and has no touch index
+ */
+extern GfxDisplayList gfx_compile_display_list(struct GuiElement* elements, size_t elementCount);
+
+/**
+ * @brief Submit display list
+ * Submits all operations of the display list to the render queue.
+ *
+ * @param list Display list
+ */
+extern void gfx_display_list_submit(GfxDisplayList* list);
+
+/**
+ * @brief Update element in display list
+ * Regenerates the operations of the element (and its children) in place
+ * and submits only those operations. The element must keep its type,
+ * element types always generate the same number of operations. Stale
+ * operations still waiting in the queue are replaced, if one of them
+ * is being rendered the element is left dirty and patched by the next
+ * gfx_display_list_update_dirty().
+ *
+ * @param list Display list
+ * @param element Changed element
+ * @return uint8_t 0 if the element is being rendered and was left dirty
+ */
+extern uint8_t gfx_display_list_update(GfxDisplayList* list, struct GuiElement* element);
+
+/**
+ * @brief Update dirty elements in display list
+ * Patches and submits every dirty element and every value
+ * element whose formatted text has changed, elements which are
+ * being rendered stay dirty until the next call.
+ *
+ * @param list Display list
+ */
+extern void gfx_display_list_update_dirty(GfxDisplayList* list);
+
+/**
+ * @brief Refresh display list
+ * Regenerates the operations of every dirty element (and every value
+ * element whose text has changed) without submitting them, used before
+ * submitting the whole list again.
+ *
+ * @param list Display list
+ * @return size_t Number of regenerated elements
+ */
+extern size_t gfx_display_list_refresh(GfxDisplayList* list);
+
+/**
+ * @brief Hide display list
+ * Takes the queued operations of the list out of the render queue and
+ * stops plots, lists and readouts of the list from drawing on their own.
+ * Those elements are marked dirty, gfx_display_list_refresh() brings them
+ * back before the list is submitted again.
+ *
+ * @param list Display list
+ */
+extern void gfx_display_list_hide(GfxDisplayList* list);
+
+/**
+ * @brief Get display list size
+ *
+ * @param list Display list
+ * @return size_t Heap memory used by the list and its touch index in bytes
+ */
+extern size_t gfx_display_list_size(const GfxDisplayList* list);
+
+/**
+ * @brief Initialize frame scheduler
+ * The scheduler collects changes to a display list between frames and
+ * flushes them at most `maxFps` times per second. Operations of changed
+ * elements which are still waiting in the queue are cancelled and patched
+ * with the newest state, so fast updates never build up a backlog.
+ *
+ * @param scheduler Scheduler
+ * @param list Display list
+ * @param maxFps Maximum number of frames per second (0 for no limit)
+ */
+extern void gfx_scheduler_init(GfxScheduler* scheduler, GfxDisplayList* list, uint16_t maxFps);
+
+/**
+ * @brief Invalidate element
+ * Schedules the element to be redrawn in the next frame,
+ * the element is drawn with its state at the time of the flush.
+ *
+ * @param scheduler Scheduler
+ * @param element Changed element
+ */
+extern void gfx_scheduler_invalidate(GfxScheduler* scheduler, struct GuiElement* element);
+
+/**
+ * @brief Poll frame scheduler
+ * Has to be called periodically. If enough time has passed since the last
+ * frame, patches all dirty elements (and changed value elements) and starts
+ * the render. Elements whose operations are being rendered at that moment
+ * are left for the next frame.
+ *
+ * @param scheduler Scheduler
+ * @param now Current time in milliseconds
+ * @return size_t Number of redrawn elements, 0 if no frame was flushed
+ */
+extern size_t gfx_scheduler_poll(GfxScheduler* scheduler, uint32_t now);
+
+/**
+ * @brief Delete display list
+ * Frees the display list, none of its operations can be
+ * in the render queue when this function is called.
+ *
+ * @param list Display list
+ */
+extern void gfx_delete_display_list(GfxDisplayList list);
+
+/**
+ * @brief Push plot sample
+ * Stores a sample in the ring buffer and submits the operations
+ * which draw it (and erase the oldest one), see gfx_plot_flush().
+ *
+ * @param plot Plot state
+ * @param value Sample
+ */
+extern void gfx_plot_push(GfxPlot* plot, int16_t value);
+
+/**
+ * @brief Flush plot
+ * Draws the samples pushed since the last flush, only their columns
+ * (or rows when scrolling) are sent. If the operations from the previous
+ * flush are still in flight the samples are kept for the next one.
+ * Nothing is drawn before the plot element has been rendered.
+ *
+ * @param plot Plot state
+ * @return size_t Number of submitted operations
+ */
+extern size_t gfx_plot_flush(GfxPlot* plot);
+
+/**
+ * @brief Update readout
+ * Formats the bound value and redraws only the segments which changed,
+ * readouts in a render chain or a display list are updated together
+ * with value elements. Nothing is drawn before the element is rendered.
+ * Segments whose operation is still in flight keep their old state
+ * and are redrawn by a later update.
+ *
+ * @param readout Readout element
+ * @return size_t Number of submitted operations
+ */
+extern size_t gfx_update_readout(struct GuiElement* readout);
+
+/**
+ * @brief Scroll list
+ * Moves the list to a scroll position (clamped to the content), the
+ * rows are drawn by the next gfx_list_flush() or gfx_list_poll().
+ *
+ * @param list List state
+ * @param offset Scroll position in pixels
+ */
+extern void gfx_list_scroll_to(GfxList* list, int32_t offset);
+
+/**
+ * @brief Invalidate list
+ * Redraws every visible row at the next flush, has to be
+ * called when the rows (or the row count) change.
+ *
+ * @param list List state
+ */
+extern void gfx_list_invalidate(GfxList* list);
+
+/**
+ * @brief Flush list
+ * Draws the rows exposed since the last flush. Lists spanning the whole
+ * screen width scroll the panel with the vertical scroll registers, so
+ * only the exposed strip is sent, narrower lists redraw all visible rows.
+ * Nothing is drawn while the previous flush is still in flight or before
+ * the list element has been rendered.
+ *
+ * @param list List state
+ * @return size_t Number of drawn rows
+ */
+extern size_t gfx_list_flush(GfxList* list);
+
+/**
+ * @brief Poll list
+ * Moves the list by its inertia after a drag and flushes it, has
+ * to be called periodically from the main loop (every few ms).
+ *
+ * @param list List state
+ * @param now Current time in milliseconds
+ * @return size_t Number of drawn rows
+ */
+extern size_t gfx_list_poll(GfxList* list, uint32_t now);
+
+/**
+ * @brief Free list operations
+ * Frees the operations allocated by the list, none
+ * of them can be in the render queue.
+ *
+ * @param list List state
+ */
+extern void gfx_list_free(GfxList* list);
+
+/**
+ * @brief Initialize screen manager
+ * The manager keeps the display lists and touch indices of the registered
+ * screens, a screen is only compiled the first time it is shown. Once the
+ * cached screens use more than `budget` bytes the least recently shown
+ * ones are freed.
+ *
+ * @param manager Screen manager
+ * @param budget Memory limit of the cached screens in bytes
+ */
+extern void gfx_screens_init(GfxScreenManager* manager, size_t budget);
+
+/**
+ * @brief Register screen
+ * The elements have to stay valid as long as the manager is used.
+ *
+ * @param manager Screen manager
+ * @param elements Root elements of the screen
+ * @param count Number of root elements
+ * @return int Index of the screen, -1 if there are already GFX_MAX_SCREENS screens
+ */
+extern int gfx_screen_register(GfxScreenManager* manager, struct GuiElement* elements, size_t count);
+
+/**
+ * @brief Show screen
+ * Hides the current screen and submits the whole display list of the new
+ * one, the touch index is switched before anything else can be touched.
+ * Cached screens only regenerate the elements which were marked dirty
+ * (or whose values changed) while they were hidden. Hardware scrolling
+ * is reset and pressed buttons or dragged lists are forgotten.
+ *
+ * @param manager Screen manager
+ * @param index Index of the screen
+ * @return uint8_t 0 if there is no such screen or its boxes are nested
+ *                 deeper than GFX_MAX_DEPTH, the current screen stays
+ */
+extern uint8_t gfx_screen_show(GfxScreenManager* manager, int index);
+
+/**
+ * @brief Update shown screen
+ * Patches and submits the dirty elements of the shown screen,
+ * see gfx_display_list_update_dirty().
+ *
+ * @param manager Screen manager
+ */
+extern void gfx_screen_update(GfxScreenManager* manager);
+
+/**
+ * @brief Free screen manager
+ * Frees all cached screens, none of their operations
+ * can be in the render queue.
+ *
+ * @param manager Screen manager
+ */
+extern void gfx_screens_free(GfxScreenManager* manager);
+
+/**
+ * @brief Format a fixed-point value
+ * Formats a signed fixed-point number into a text buffer without
+ * using printf or allocating memory. The value is interpreted as
+ * having `decimals` decimal places, e.g. 12345 with 2 decimals
+ * is formatted as "123.45".
+ *
+ * @param buffer Output buffer, at least GFX_VALUE_MAX_LENGTH bytes long
+ * @param value Value to format
+ * @param minWidth Minimum length of the result, shorter values are padded
+ * @param decimals Number of decimal places (at most VALUE_MAX_DECIMALS)
+ * @param flags Combination of VALUE_SIGN_* and VALUE_PAD_ZERO flags
+ * @return size_t Length of the formatted text
+ */
+extern size_t gfx_format_value(char* buffer, int32_t value, uint8_t minWidth, uint8_t decimals, uint8_t flags);
+
 #define GUI_BUTTON(x, y, width, height, color, textcolor, text, align, font, clickcb) \
     { GFX_BUTTON, x, y, width, height, \
       .ge_color = color, \
@@ -141,6 +926,159 @@ extern void gfx_delete_render_chain(GfxRenderChain chain);
         .ge_clickCallback = clickcb, \
         .ge_rle = rle, \
         .ge_imageScale = scale } }
+#define GUI_IMAGE(x, y, width, height, format, bitmap) \
+    { GFX_IMAGE, x, y, width, height, \
+      .ge_image = { \
+        .ge_bitmap = bitmap, \
+        .ge_format = format, \
+        .ge_imageScale = 1 } }
+// Palette images are scaled like image buttons, width and height are the size on screen
+#define GUI_PALETTE_IMAGE(x, y, width, height, scale, bpp, palette, bitmap) \
+    { GFX_IMAGE, x, y, width, height, \
+      .ge_image = { \
+        .ge_bitmap = bitmap, \
+        .ge_format = PALETTE_BITMAP, \
+        .ge_imageScale = scale, \
+        .ge_palette = palette, \
+        .ge_bpp = bpp } }
+// Pixel run images are drawn with the element color on the parent color
+#define GUI_RUN_IMAGE(x, y, width, height, scale, color, bitmap) \
+    { GFX_IMAGE, x, y, width, height, \
+      .ge_color = color, \
+      .ge_image = { \
+        .ge_bitmap = bitmap, \
+        .ge_format = RUN_BITMAP, \
+        .ge_imageScale = scale } }
+// Image from an asset pack, `name` is the asset macro prefix (e.g. ASSET_LOGO),
+// 1bpp assets are drawn with the element color on the parent color,
+// color assets are never scaled
+#define GUI_ASSET(x, y, scale, color, name) \
+    { GFX_IMAGE, x, y, \
+      name##_WIDTH * TFT_ASSET_SCALE(name##_FORMAT, scale), \
+      name##_HEIGHT * TFT_ASSET_SCALE(name##_FORMAT, scale), \
+      .ge_color = color, \
+      .ge_image = { \
+        .ge_bitmap = name##_DATA, \
+        .ge_format = name##_FORMAT, \
+        .ge_imageScale = TFT_ASSET_SCALE(name##_FORMAT, scale), \
+        .ge_palette = name##_PALETTE, \
+        .ge_bpp = name##_BPP } }
+// Gradient filled rectangle, children of the parent box are still drawn on the parent color
+#define GUI_GRADIENT(x, y, width, height, fromColor, toColor, direction) \
+    { GFX_GRADIENT, x, y, width, height, \
+      .ge_color = fromColor, \
+      .ge_gradient = { \
+        .ge_toColor = toColor, \
+        .ge_direction = direction } }
+// Shapes are drawn on the parent color, a thickness of 0 draws filled shapes
+#define GUI_LINE(x0, y0, x1, y1, color) \
+    { GFX_SHAPE, (x0) < (x1) ? (x0) : (x1), (y0) < (y1) ? (y0) : (y1), \
+      ((x0) < (x1) ? (x1) - (x0) : (x0) - (x1)) + 1, ((y0) < (y1) ? (y1) - (y0) : (y0) - (y1)) + 1, \
+      .ge_color = color, \
+      .ge_shape = { \
+        .ge_kind = LINE, \
+        .ge_x0 = (x0) < (x1) ? 0 : (x0) - (x1), \
+        .ge_y0 = (y0) < (y1) ? 0 : (y0) - (y1), \
+        .ge_x1 = (x0) < (x1) ? (x1) - (x0) : 0, \
+        .ge_y1 = (y0) < (y1) ? (y1) - (y0) : 0 } }
+#define GUI_CIRCLE(cx, cy, radius, thickness, color) \
+    { GFX_SHAPE, (cx) - (radius), (cy) - (radius), (radius) * 2 + 1, (radius) * 2 + 1, \
+      .ge_color = color, \
+      .ge_shape = { \
+        .ge_kind = CIRCLE, \
+        .ge_x0 = radius, \
+        .ge_y0 = radius, \
+        .ge_radius = radius, \
+        .ge_thickness = thickness } }
+// Angles are in degrees, clockwise from 3 o'clock
+#define GUI_ARC(cx, cy, radius, thickness, startAngle, endAngle, color) \
+    { GFX_SHAPE, (cx) - (radius), (cy) - (radius), (radius) * 2 + 1, (radius) * 2 + 1, \
+      .ge_color = color, \
+      .ge_shape = { \
+        .ge_kind = ARC, \
+        .ge_x0 = radius, \
+        .ge_y0 = radius, \
+        .ge_x1 = startAngle, \
+        .ge_y1 = endAngle, \
+        .ge_radius = radius, \
+        .ge_thickness = thickness } }
+#define GUI_ROUND_RECT(x, y, width, height, radius, thickness, color) \
+    { GFX_SHAPE, x, y, width, height, \
+      .ge_color = color, \
+      .ge_shape = { \
+        .ge_kind = ROUND_RECT, \
+        .ge_radius = radius, \
+        .ge_thickness = thickness } }
+// Sweep plots need width - 1 samples and scrolling plots (PLOT_SCROLL)
+// need height samples, scrolling plots have to span the whole screen width.
+#define GUI_PLOT_STATE(samples, min, max, gridStep, gridColor, axisColor, flags) \
+    { .gp_plot = { \
+        .lp_samples = samples, \
+        .lp_capacity = sizeof(samples) / sizeof(samples[0]), \
+        .lp_min = min, \
+        .lp_max = max, \
+        .lp_gridColor = gridColor, \
+        .lp_axisColor = axisColor, \
+        .lp_gridStep = gridStep, \
+        .lp_flags = flags } }
+// The trace is drawn with the given color over the parent color. Sweep plots
+// need fewer samples than the width (the first column is the axis), scrolling
+// plots span the whole screen width and have a sample for every row.
+#define GUI_PLOT(x, y, width, height, color, state) \
+    { GFX_PLOT, x, y, width, height, \
+      .ge_color = color, \
+      .ge_plot = { \
+        .ge_state = &state } }
+// The list background is the element color, a list which should
+// scroll smoothly has to span the whole screen width. The panel has one
+// scroll area, a tree can't have a full width list and a scrolling plot.
+#define GUI_LIST_STATE(rowCount, rowHeight, renderRow, rowTap, arg) \
+    { .gl_rowCount = rowCount, \
+      .gl_rowHeight = rowHeight, \
+      .gl_renderRow = renderRow, \
+      .gl_rowTap = rowTap, \
+      .gl_arg = arg }
+#define GUI_LIST(x, y, width, height, color, state) \
+    { GFX_LIST, x, y, width, height, \
+      .ge_color = color, \
+      .ge_list = { \
+        .ge_state = &state } }
+// Seven segment readout of a fixed-point value, the digits are digitHeight tall
+// and digitHeight / 2 + digitHeight / 4 wide (including the decimal point).
+// Readouts keep their segments in the element, like value elements they have
+// to be placed in a writable (non const) array. Digits are at least 10 pixels tall.
+// The state (GfxReadout) holds the operations which redraw changed segments.
+#define GUI_READOUT(x, y, digitHeight, color, offColor, source, digits, decimals, flags, state) \
+    { GFX_READOUT, x, y, 0, digitHeight, \
+      .ge_color = color, \
+      .ge_readout = { \
+        .ge_source = &source, \
+        .ge_state = &state, \
+        .ge_offColor = offColor, \
+        .ge_digits = digits, \
+        .ge_decimals = decimals, \
+        .ge_flags = flags } }
+// Value elements keep their formatted text inside of the element,
+// so they have to be placed in a writable (non const) array.
+#define GUI_VALUE(x, y, color, source, minwidth, decimals, flags, font) \
+    { GFX_VALUE, x, y, \
+      .ge_color = color, \
+      .ge_value = { \
+        .ge_source = &source, \
+        .ge_font = &font, \
+        .ge_minWidth = minwidth, \
+        .ge_decimals = decimals, \
+        .ge_flags = flags } }
+#define GUI_VALUE_RIGHT(x, y, color, source, minwidth, decimals, flags, font) \
+    { GFX_VALUE, x, y, \
+      .ge_color = color, \
+      .ge_value = { \
+        .ge_source = &source, \
+        .ge_font = &font, \
+        .ge_minWidth = minwidth, \
+        .ge_decimals = decimals, \
+        .ge_flags = flags, \
+        .ge_textAlign = ALIGN_RIGHT } }
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,234 @@
+#include "gfx.h"
+
+#include <assert.h>
+#include <string.h>
+
+// Longest time step of the inertia, polls after a pause don't jump
+#define MAX_POLL_STEP 100
+// Inertia stops below this velocity (pixels per second)
+#define MIN_VELOCITY 20
+
+int32_t gfx_list_clamp(const GfxList* list, int32_t offset) {
+    const int32_t content = (int32_t)list->gl_rowCount * list->gl_rowHeight;
+    const int32_t maxOffset = content > list->gl_height ? content - list->gl_height : 0;
+
+    if(offset > maxOffset)
+        offset = maxOffset;
+    if(offset < 0)
+        offset = 0;
+    return offset;
+}
+
+// Touch regions of lists are handled by the touch dispatcher
+void gfx_list_touched(const void* element) {
+    (void)element;
+}
+
+// Called after the last operation of a flush has been sent
+void gfx_list_drawn(void* arg) {
+    GfxList* list = arg;
+    list->gl_inFlight = 0;
+}
+
+void gfx_list_scroll_to(GfxList* list, int32_t offset) {
+    list->gl_offset = gfx_list_clamp(list, offset);
+    list->gl_velocity = 0;
+    list->gl_fraction = 0;
+}
+
+void gfx_list_invalidate(GfxList* list) {
+    list->gl_drawn = 0;
+    list->gl_offset = gfx_list_clamp(list, list->gl_offset);
+}
+
+/**
+ * @brief Allocate row operations
+ * A flush draws at most the rows of the whole list height, every
+ * row has its members and at most two composites (the second one
+ * if the row goes over the end of the scroll area).
+ */
+void gfx_list_pool(GfxList* list) {
+    const size_t rows = list->gl_height / list->gl_rowHeight + 2;
+    if(list->gl_poolRows >= rows)
+        return;
+
+    free(list->gl_members);
+    free(list->gl_composites);
+    list->gl_members = malloc(sizeof(struct LcdOperation) * rows * (GFX_LIST_ROW_OPS + 1));
+    list->gl_composites = malloc(sizeof(struct LcdOperation) * rows * 2);
+    list->gl_poolRows = rows;
+}
+
+size_t gfx_list_flush(GfxList* list) {
+    if(!list->gl_visible || !list->gl_rowHeight || list->gl_inFlight)
+        return 0;
+
+    const int32_t target = gfx_list_clamp(list, list->gl_offset);
+    if(list->gl_drawn && target == list->gl_drawnOffset)
+        return 0;
+
+    // Content row v is kept in row (v - base) % height of the list area,
+    // hardware scrolling only works with whole panel rows.
+    const int32_t height = list->gl_height;
+    const int32_t rowHeight = list->gl_rowHeight;
+    const uint8_t scroll = list->gl_x == 0 && list->gl_width == TFT_WIDTH;
+    const int32_t base = scroll ? 0 : target;
+
+    // Only the strip which scrolled into view is drawn
+    int32_t start = target;
+    int32_t end = target + height;
+    if(scroll && list->gl_drawn) {
+        const int32_t delta = target - list->gl_drawnOffset;
+        if(delta > 0 && delta < height)
+            start = list->gl_drawnOffset + height;
+        else if(delta < 0 && -delta < height)
+            end = list->gl_drawnOffset;
+    }
+
+    gfx_list_pool(list);
+
+    size_t rows = 0;
+    struct LcdOperation* composite = list->gl_composites;
+    for(int32_t row = start / rowHeight; row * rowHeight < end; ++row, ++rows) {
+        struct LcdOperation* members = list->gl_members + rows * (GFX_LIST_ROW_OPS + 1);
+        memset(members, 0, sizeof(struct LcdOperation) * (GFX_LIST_ROW_OPS + 1));
+
+        // Members are positioned relative to the row, the first one clears it
+        members[0].lo_op = RECT_FILL;
+        members[0].lo_fg = list->gl_background;
+        members[0].lo_x = list->gl_x;
+        members[0].lo_rect.width = list->gl_width;
+        members[0].lo_rect.height = rowHeight;
+
+        size_t count = 1;
+        if((uint32_t)row < list->gl_rowCount) {
+            count += list->gl_renderRow(list, row, members + 1, GFX_LIST_ROW_OPS);
+            // Writing more operations overflowed into the next row
+            assert(count <= GFX_LIST_ROW_OPS + 1);
+            if(count > GFX_LIST_ROW_OPS + 1)
+                count = GFX_LIST_ROW_OPS + 1;
+            for(size_t i = 1; i < count; ++i)
+                members[i].lo_x += list->gl_x;
+        }
+
+        int32_t y = row * rowHeight > start ? row * rowHeight : start;
+        const int32_t rowEnd = (row + 1) * rowHeight < end ? (row + 1) * rowHeight : end;
+        while(y < rowEnd) {
+            const int32_t areaRow = (y - base) % height;
+            int32_t length = rowEnd - y;
+            if(length > height - areaRow)
+                length = height - areaRow;
+
+            memset(composite, 0, sizeof(struct LcdOperation));
+            composite->lo_op = COMPOSITE;
+            composite->lo_static = 1;
+            composite->lo_x = list->gl_x;
+            composite->lo_y = list->gl_y + areaRow;
+            composite->lo_composite.ops = members;
+            composite->lo_composite.count = count;
+            composite->lo_composite.width = list->gl_width;
+            composite->lo_composite.height = length;
+            composite->lo_composite.shift = list->gl_y + areaRow - (y - row * rowHeight);
+            tft_submit(composite++);
+
+            y += length;
+        }
+    }
+
+    if(scroll) {
+        // New rows are in place before they are scrolled into view
+        struct LcdOperation* op = &list->gl_scrollOp;
+        op->lo_op = SCROLL;
+        op->lo_static = 1;
+        op->lo_scroll.top = list->gl_y;
+        op->lo_scroll.height = height;
+        op->lo_scroll.start = list->gl_y + target % height;
+        tft_submit(op);
+    }
+
+    // Continuations of the composites still use the members until this is called
+    list->gl_inFlight = 1;
+    list->gl_doneOp.lo_op = CALLBACK;
+    list->gl_doneOp.lo_static = 1;
+    list->gl_doneOp.lo_callback.function = gfx_list_drawn;
+    list->gl_doneOp.lo_callback.arg = list;
+    tft_submit(&list->gl_doneOp);
+    tft_start_render();
+
+    list->gl_drawnOffset = target;
+    list->gl_drawn = 1;
+    return rows;
+}
+
+size_t gfx_list_poll(GfxList* list, uint32_t now) {
+    int32_t step = now - list->gl_pollTick;
+    if(step > MAX_POLL_STEP)
+        step = MAX_POLL_STEP;
+    list->gl_pollTick = now;
+
+    if(list->gl_dragging) {
+        if(step > 0) {
+            // Smoothed velocity of the finger
+            const int32_t velocity = (list->gl_offset - list->gl_pollOffset) * 1000 / step;
+            list->gl_velocity = (list->gl_velocity + velocity) / 2;
+        }
+    } else if(list->gl_velocity && step > 0) {
+        const int32_t move = list->gl_velocity * step + list->gl_fraction;
+        const int32_t offset = list->gl_offset + move / 1000;
+        list->gl_fraction = move % 1000;
+        list->gl_offset = gfx_list_clamp(list, offset);
+
+        // Exponential decay (at least 1 px/s), hitting either end stops the list
+        int32_t decay = list->gl_velocity * step / GFX_LIST_FRICTION_MS;
+        if(!decay)
+            decay = list->gl_velocity > 0 ? 1 : -1;
+        list->gl_velocity -= decay;
+        if(list->gl_offset != offset || (list->gl_velocity < MIN_VELOCITY && list->gl_velocity > -MIN_VELOCITY)) {
+            list->gl_velocity = 0;
+            list->gl_fraction = 0;
+        }
+    }
+
+    list->gl_pollOffset = list->gl_offset;
+    return gfx_list_flush(list);
+}
+
+void gfx_list_touch(GfxList* list, uint16_t y) {
+    list->gl_dragging = 1;
+    list->gl_moved = 0;
+    list->gl_dragY = y;
+    list->gl_dragOffset = list->gl_offset;
+    list->gl_velocity = 0;
+    list->gl_fraction = 0;
+}
+
+void gfx_list_drag(GfxList* list, uint16_t y) {
+    const int32_t delta = (int32_t)list->gl_dragY - y;
+    if(!list->gl_moved && (delta >= GFX_LIST_DRAG_THRESHOLD || delta <= -GFX_LIST_DRAG_THRESHOLD))
+        list->gl_moved = 1;
+
+    if(list->gl_moved) {
+        list->gl_offset = gfx_list_clamp(list, list->gl_dragOffset + delta);
+        gfx_list_flush(list);
+    }
+}
+
+void gfx_list_release(GfxList* list) {
+    list->gl_dragging = 0;
+    if(list->gl_moved)
+        return;
+
+    // A tap, the list keeps its velocity only after a drag
+    list->gl_velocity = 0;
+    const uint32_t row = (list->gl_dragOffset + list->gl_dragY - list->gl_y) / list->gl_rowHeight;
+    if(list->gl_rowTap && row < list->gl_rowCount)
+        list->gl_rowTap(list, row);
+}
+
+void gfx_list_free(GfxList* list) {
+    free(list->gl_members);
+    free(list->gl_composites);
+    list->gl_members = 0;
+    list->gl_composites = 0;
+    list->gl_poolRows = 0;
+}
@@ -0,0 +1,531 @@
+#include "gfx.h"
+
+#include <string.h>
+
+// Maximum number of pieces a fill can be split into
+#define MAX_FRAGMENTS 32
+// Every extra operation costs a window setup, it is
+// roughly as expensive as sending this many pixels
+#define OPERATION_COST 32
+
+typedef struct Rect_t {
+    uint16_t r_x;
+    uint16_t r_y;
+    uint16_t r_width;
+    uint16_t r_height;
+} Rect;
+
+/**
+ * @brief Get operation bounds
+ * Calculates the area an operation will write to.
+ *
+ * @param op Operation
+ * @param rect Output rectangle
+ * @return uint8_t 1 if the whole area is overwritten (opaque)
+ */
+uint8_t gfx_operation_bounds(const struct LcdOperation* op, Rect* rect) {
+    rect->r_x = op->lo_x;
+    rect->r_y = op->lo_y;
+
+    // Unknown area, this operation doesn't hide anything
+    return tft_operation_size(op, &rect->r_width, &rect->r_height);
+}
+
+/**
+ * @brief Subtract rectangles
+ * Splits `a` into the parts which are not covered by `b`.
+ *
+ * @param a Rectangle to subtract from
+ * @param b Subtracted rectangle
+ * @param out Output array, has to have space for 4 rectangles
+ * @return size_t Number of output rectangles
+ */
+size_t gfx_rect_subtract(const Rect* a, const Rect* b, Rect* out) {
+    uint32_t ax1 = a->r_x + a->r_width, ay1 = a->r_y + a->r_height;
+    uint32_t bx1 = b->r_x + b->r_width, by1 = b->r_y + b->r_height;
+
+    if(b->r_x >= ax1 || b->r_y >= ay1 || bx1 <= a->r_x || by1 <= a->r_y) {
+        // No intersection
+        out[0] = *a;
+        return 1;
+    }
+
+    size_t count = 0;
+    uint16_t top = b->r_y > a->r_y ? b->r_y : a->r_y;
+    uint16_t bottom = by1 < ay1 ? by1 : ay1;
+
+    if(b->r_y > a->r_y)
+        out[count++] = (Rect) { a->r_x, a->r_y, a->r_width, b->r_y - a->r_y };
+    if(by1 < ay1)
+        out[count++] = (Rect) { a->r_x, by1, a->r_width, ay1 - by1 };
+    if(b->r_x > a->r_x)
+        out[count++] = (Rect) { a->r_x, top, b->r_x - a->r_x, bottom - top };
+    if(bx1 < ax1)
+        out[count++] = (Rect) { bx1, top, ax1 - bx1, bottom - top };
+
+    return count;
+}
+
+/**
+ * @brief Find visible parts of an operation
+ * Subtracts the areas of all later opaque operations from the operation.
+ *
+ * @param ops Operation array
+ * @param count Length of the array
+ * @param index Index of the operation
+ * @param fragments Output array of MAX_FRAGMENTS rectangles
+ * @return int Number of visible pieces, -1 if there are too many of them
+ */
+int gfx_visible_fragments(const struct LcdOperation* ops, size_t count, size_t index, Rect* fragments) {
+    Rect split[MAX_FRAGMENTS + 4];
+    size_t fragmentCount = 1;
+
+    gfx_operation_bounds(ops + index, fragments);
+    if(!fragments[0].r_width || !fragments[0].r_height)
+        return 0;
+
+    for(size_t i = index + 1; i < count && fragmentCount; ++i) {
+        Rect cover;
+        if(!gfx_operation_bounds(ops + i, &cover) || !cover.r_width || !cover.r_height)
+            continue;
+
+        size_t splitCount = 0;
+        for(size_t j = 0; j < fragmentCount; ++j) {
+            // One subtraction produces at most 4 rectangles
+            if(splitCount > MAX_FRAGMENTS)
+                return -1;
+            splitCount += gfx_rect_subtract(fragments + j, &cover, split + splitCount);
+        }
+
+        if(splitCount > MAX_FRAGMENTS)
+            return -1;
+
+        memcpy(fragments, split, sizeof(Rect) * splitCount);
+        fragmentCount = splitCount;
+    }
+
+    return fragmentCount;
+}
+
+uint32_t gfx_rect_area(const Rect* rect) {
+    return (uint32_t)rect->r_width * rect->r_height;
+}
+
+uint32_t gfx_fragments_area(const Rect* fragments, int count) {
+    uint32_t area = 0;
+    for(int i = 0; i < count; ++i)
+        area += gfx_rect_area(fragments + i);
+    return area;
+}
+
+/**
+ * @brief Check if a fill should be split
+ * Splitting a fill into its visible pieces is only worth
+ * it if the saved pixels outweigh the extra operations.
+ *
+ * @param op Fill operation
+ * @param count Number of visible pieces
+ * @param visible Visible area
+ * @return uint8_t 1 if the fill should be replaced by the pieces
+ */
+uint8_t gfx_worth_splitting(const struct LcdOperation* op, int count, uint32_t visible) {
+    if(op->lo_op != RECT_FILL || count < 0)
+        return 0;
+    if(count == 0)
+        return 1;
+
+    uint32_t saved = (uint32_t)op->lo_rect.width * op->lo_rect.height - visible;
+    return saved > (uint32_t)(count - 1) * OPERATION_COST;
+}
+
+GfxOverdrawStats gfx_eliminate_overdraw(GfxRenderChain* chain) {
+    GfxOverdrawStats stats;
+    memset(&stats, 0, sizeof(stats));
+
+    Rect fragments[MAX_FRAGMENTS];
+    size_t newLength = 0;
+
+    // First pass, measure everything and count the resulting operations
+    for(size_t i = 0; i < chain->grc_length; ++i) {
+        const struct LcdOperation* op = chain->grc_operations + i;
+
+        Rect bounds;
+        gfx_operation_bounds(op, &bounds);
+        uint32_t area = gfx_rect_area(&bounds);
+        stats.gos_pixelsBefore += area;
+
+        int count = gfx_visible_fragments(chain->grc_operations, chain->grc_length, i, fragments);
+        // Too complicated, count it as fully visible
+        uint32_t visible = count < 0 ? area : gfx_fragments_area(fragments, count);
+        stats.gos_visiblePixels += visible;
+
+        if(gfx_worth_splitting(op, count, visible)) {
+            newLength += count;
+            stats.gos_pixelsAfter += visible;
+        } else {
+            ++newLength;
+            stats.gos_pixelsAfter += area;
+        }
+    }
+
+    if(stats.gos_visiblePixels) {
+        stats.gos_ratioBefore = stats.gos_pixelsBefore * 100 / stats.gos_visiblePixels;
+        stats.gos_ratioAfter = stats.gos_pixelsAfter * 100 / stats.gos_visiblePixels;
+    }
+
+    // Second pass, replace fills with their visible pieces
+    struct LcdOperation* ops = malloc(sizeof(struct LcdOperation) * newLength);
+    size_t index = 0;
+
+    for(size_t i = 0; i < chain->grc_length; ++i) {
+        const struct LcdOperation* op = chain->grc_operations + i;
+
+        int count = -1;
+        if(op->lo_op == RECT_FILL)
+            count = gfx_visible_fragments(chain->grc_operations, chain->grc_length, i, fragments);
+
+        if(!gfx_worth_splitting(op, count, gfx_fragments_area(fragments, count))) {
+            memcpy(ops + index++, op, sizeof(struct LcdOperation));
+            continue;
+        }
+
+        for(int j = 0; j < count; ++j) {
+            struct LcdOperation* fill = ops + index++;
+            memcpy(fill, op, sizeof(struct LcdOperation));
+            fill->lo_x = fragments[j].r_x;
+            fill->lo_y = fragments[j].r_y;
+            fill->lo_rect.width = fragments[j].r_width;
+            fill->lo_rect.height = fragments[j].r_height;
+        }
+    }
+
+    free(chain->grc_operations);
+    chain->grc_operations = ops;
+    chain->grc_length = newLength;
+
+    return stats;
+}
+
+/********** Chain optimisation **********/
+
+// How many of the following operations are considered when reordering
+#define REORDER_LOOKAHEAD 16
+
+uint8_t gfx_rects_overlap(const Rect* a, const Rect* b) {
+    return a->r_x < b->r_x + b->r_width && b->r_x < a->r_x + a->r_width &&
+           a->r_y < b->r_y + b->r_height && b->r_y < a->r_y + a->r_height;
+}
+
+/**
+ * @brief Check if two operations can be swapped
+ * Operations which overlap (or have an unknown area) have to
+ * stay in the same order to preserve the painter's order.
+ */
+uint8_t gfx_independent(const struct LcdOperation* a, const struct LcdOperation* b) {
+    Rect ra, rb;
+    if(!gfx_operation_bounds(a, &ra) || !gfx_operation_bounds(b, &rb))
+        return 0;
+    return !gfx_rects_overlap(&ra, &rb);
+}
+
+/**
+ * @brief Get DMA mode of operation
+ *
+ * @return uint8_t 0 for fills (memory not incremented), 1 for buffer transfers
+ */
+uint8_t gfx_dma_mode(const struct LcdOperation* op) {
+    return op->lo_op != RECT_FILL && op->lo_op != VGRADIENT_FILL;
+}
+
+/**
+ * @brief Count window commands
+ * Counts the column and page address commands the driver has to send,
+ * it only sends the ones that differ from the previous window.
+ */
+void gfx_count_switches(const struct LcdOperation* ops, size_t count, uint16_t* modeSwitches, uint16_t* windowCommands) {
+    Rect prev = { 0, 0, 0, 0 };
+    *modeSwitches = 0;
+    *windowCommands = 0;
+
+    for(size_t i = 0; i < count; ++i) {
+        Rect rect;
+        gfx_operation_bounds(ops + i, &rect);
+
+        if(i == 0 || gfx_dma_mode(ops + i) != gfx_dma_mode(ops + i - 1))
+            ++*modeSwitches;
+        if(i == 0 || rect.r_x != prev.r_x || rect.r_width != prev.r_width)
+            ++*windowCommands;
+        if(i == 0 || rect.r_y != prev.r_y || rect.r_height != prev.r_height)
+            ++*windowCommands;
+
+        prev = rect;
+    }
+}
+
+/**
+ * @brief Check if an area is touched between two operations
+ *
+ * @return uint8_t 1 if any operation between `from` and `to` (exclusive) overlaps the area
+ */
+uint8_t gfx_touched_between(const struct LcdOperation* ops, const uint8_t* removed, size_t from, size_t to, const Rect* area) {
+    for(size_t k = from + 1; k < to; ++k) {
+        if(removed[k])
+            continue;
+
+        Rect rect;
+        if(!gfx_operation_bounds(ops + k, &rect) || gfx_rects_overlap(&rect, area))
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Merge two fills
+ * Merges fill `j` into fill `i` (or the other way around) if they have the same
+ * color and together form a rectangle, without changing what ends up on screen.
+ *
+ * @param drop Output index of the removed operation
+ * @return uint8_t 1 if the fills were merged
+ */
+uint8_t gfx_merge_fills(struct LcdOperation* ops, const uint8_t* removed, size_t i, size_t j, size_t* drop) {
+    struct LcdOperation* a = ops + i;
+    struct LcdOperation* b = ops + j;
+    if(a->lo_op != RECT_FILL || b->lo_op != RECT_FILL || a->lo_fg.word != b->lo_fg.word)
+        return 0;
+
+    Rect ra = { a->lo_x, a->lo_y, a->lo_rect.width, a->lo_rect.height };
+    Rect rb = { b->lo_x, b->lo_y, b->lo_rect.width, b->lo_rect.height };
+
+    uint8_t vertical = ra.r_x == rb.r_x && ra.r_width == rb.r_width &&
+                       rb.r_y <= ra.r_y + ra.r_height && ra.r_y <= rb.r_y + rb.r_height;
+    uint8_t horizontal = ra.r_y == rb.r_y && ra.r_height == rb.r_height &&
+                         rb.r_x <= ra.r_x + ra.r_width && ra.r_x <= rb.r_x + rb.r_width;
+    if(!vertical && !horizontal)
+        return 0;
+
+    Rect merged;
+    merged.r_x = ra.r_x < rb.r_x ? ra.r_x : rb.r_x;
+    merged.r_y = ra.r_y < rb.r_y ? ra.r_y : rb.r_y;
+    merged.r_width = (ra.r_x + ra.r_width > rb.r_x + rb.r_width ? ra.r_x + ra.r_width : rb.r_x + rb.r_width) - merged.r_x;
+    merged.r_height = (ra.r_y + ra.r_height > rb.r_y + rb.r_height ? ra.r_y + ra.r_height : rb.r_y + rb.r_height) - merged.r_y;
+
+    struct LcdOperation* keep;
+    if(!gfx_touched_between(ops, removed, i, j, &rb)) {
+        // Drawing `b` earlier doesn't change anything
+        keep = a;
+        *drop = j;
+    } else if(!gfx_touched_between(ops, removed, i, j, &ra)) {
+        // Drawing `a` later doesn't change anything
+        keep = b;
+        *drop = i;
+    } else {
+        return 0;
+    }
+
+    keep->lo_x = merged.r_x;
+    keep->lo_y = merged.r_y;
+    keep->lo_rect.width = merged.r_width;
+    keep->lo_rect.height = merged.r_height;
+    return 1;
+}
+
+GfxOptimizeStats gfx_optimize_chain(GfxRenderChain* chain) {
+    GfxOptimizeStats stats;
+    memset(&stats, 0, sizeof(stats));
+
+    struct LcdOperation* ops = chain->grc_operations;
+    size_t length = chain->grc_length;
+
+    stats.gop_opsBefore = length;
+    gfx_count_switches(ops, length, &stats.gop_modeSwitchesBefore, &stats.gop_windowCommandsBefore);
+
+    uint8_t* removed = calloc(length, 1);
+    Rect fragments[MAX_FRAGMENTS];
+
+    // Drop operations which are completely overwritten later
+    for(size_t i = 0; i < length; ++i) {
+        Rect bounds;
+        if(gfx_operation_bounds(ops + i, &bounds) && !gfx_visible_fragments(ops, length, i, fragments)) {
+            removed[i] = 1;
+            ++stats.gop_dropped;
+        }
+    }
+
+    // Merge fills until nothing changes
+    uint8_t changed = 1;
+    while(changed) {
+        changed = 0;
+        for(size_t i = 0; i < length; ++i) {
+            for(size_t j = i + 1; j < length && !removed[i]; ++j) {
+                if(removed[j])
+                    continue;
+
+                size_t drop;
+                if(gfx_merge_fills(ops, removed, i, j, &drop)) {
+                    removed[drop] = 1;
+                    ++stats.gop_merged;
+                    changed = 1;
+                }
+            }
+        }
+    }
+
+    // Reorder independent operations, the next operation is picked from
+    // the ones that don't depend on anything which hasn't been emitted yet.
+    struct LcdOperation* result = malloc(sizeof(struct LcdOperation) * length);
+    size_t resultLength = 0;
+    const struct LcdOperation* last = 0;
+
+    for(;;) {
+        size_t first = 0;
+        while(first < length && removed[first])
+            ++first;
+        if(first == length)
+            break;
+
+        size_t best = first;
+        int bestScore = -1;
+        size_t considered = 0;
+
+        for(size_t j = first; j < length && considered < REORDER_LOOKAHEAD; ++j) {
+            if(removed[j])
+                continue;
+            ++considered;
+
+            uint8_t ready = 1;
+            for(size_t k = first; k < j && ready; ++k) {
+                if(!removed[k] && !gfx_independent(ops + k, ops + j))
+                    ready = 0;
+            }
+            if(!ready)
+                continue;
+
+            int score = 0;
+            if(last) {
+                Rect a, b;
+                gfx_operation_bounds(last, &a);
+                gfx_operation_bounds(ops + j, &b);
+                if(gfx_dma_mode(last) == gfx_dma_mode(ops + j))
+                    score += 2;
+                if((a.r_x == b.r_x && a.r_width == b.r_width) || (a.r_y == b.r_y && a.r_height == b.r_height))
+                    score += 1;
+            }
+
+            if(score > bestScore) {
+                best = j;
+                bestScore = score;
+            }
+        }
+
+        memcpy(result + resultLength, ops + best, sizeof(struct LcdOperation));
+        last = result + resultLength++;
+        removed[best] = 1;
+    }
+
+    free(removed);
+    free(chain->grc_operations);
+    chain->grc_operations = result;
+    chain->grc_length = resultLength;
+
+    stats.gop_opsAfter = resultLength;
+    gfx_count_switches(result, resultLength, &stats.gop_modeSwitchesAfter, &stats.gop_windowCommandsAfter);
+
+    return stats;
+}
+
+/********** Compositing **********/
+
+/**
+ * @brief Count composite members
+ * Counts the operations after `index` which lie inside of its area.
+ *
+ * @return size_t Number of following operations, 0 if the operation can't start a composite
+ */
+size_t gfx_composite_members(const struct LcdOperation* ops, size_t count, size_t index) {
+    Rect area;
+    if(!gfx_operation_bounds(ops + index, &area) || !area.r_width || !area.r_height)
+        return 0;
+
+    size_t members = 0;
+    for(size_t i = index + 1; i < count; ++i) {
+        Rect rect;
+        if(!gfx_operation_bounds(ops + i, &rect))
+            break;
+        if(rect.r_x < area.r_x || rect.r_y < area.r_y ||
+           rect.r_x + rect.r_width > area.r_x + area.r_width ||
+           rect.r_y + rect.r_height > area.r_y + area.r_height)
+            break;
+        ++members;
+    }
+    return members;
+}
+
+GfxCompositeStats gfx_composite_chain(GfxRenderChain* chain) {
+    GfxCompositeStats stats;
+    memset(&stats, 0, sizeof(stats));
+
+    const struct LcdOperation* ops = chain->grc_operations;
+    const size_t length = chain->grc_length;
+    stats.gcs_opsBefore = length;
+
+    // First pass, count the queued operations and measure both modes
+    size_t queued = 0;
+    size_t composited = 0;
+    for(size_t i = 0; i < length;) {
+        Rect rect;
+        gfx_operation_bounds(ops + i, &rect);
+        stats.gcs_pixelsComposite += gfx_rect_area(&rect);
+
+        size_t members = gfx_composite_members(ops, length, i);
+        for(size_t j = i; j <= i + members; ++j) {
+            gfx_operation_bounds(ops + j, &rect);
+            stats.gcs_pixelsDirect += gfx_rect_area(&rect);
+        }
+
+        if(members) {
+            ++stats.gcs_composites;
+            composited += members + 1;
+        }
+        ++queued;
+        i += members + 1;
+    }
+    stats.gcs_composited = composited;
+
+    // Second pass, queued operations go first and the composited ones after them
+    struct LcdOperation* result = malloc(sizeof(struct LcdOperation) * (queued + composited));
+    struct LcdOperation* member = result + queued;
+    size_t index = 0;
+
+    for(size_t i = 0; i < length;) {
+        size_t members = gfx_composite_members(ops, length, i);
+        struct LcdOperation* op = result + index++;
+
+        if(!members) {
+            memcpy(op, ops + i++, sizeof(struct LcdOperation));
+            continue;
+        }
+
+        Rect area;
+        gfx_operation_bounds(ops + i, &area);
+        memset(op, 0, sizeof(struct LcdOperation));
+        op->lo_op = COMPOSITE;
+        op->lo_x = area.r_x;
+        op->lo_y = area.r_y;
+        op->lo_composite.ops = member;
+        op->lo_composite.count = members + 1;
+        op->lo_composite.width = area.r_width;
+        op->lo_composite.height = area.r_height;
+        op->lo_composite.row = 0;
+        op->lo_composite.shift = 0;
+
+        memcpy(member, ops + i, sizeof(struct LcdOperation) * (members + 1));
+        member += members + 1;
+        i += members + 1;
+    }
+
+    free(chain->grc_operations);
+    chain->grc_operations = result;
+    chain->grc_length = queued;
+
+    return stats;
+}
@@ -0,0 +1,127 @@
+#include "gfx.h"
+
+#include <string.h>
+
+void gfx_touch_reset();
+
+void gfx_screens_init(GfxScreenManager* manager, size_t budget) {
+    memset(manager, 0, sizeof(GfxScreenManager));
+    manager->gsm_budget = budget;
+    manager->gsm_active = -1;
+}
+
+int gfx_screen_register(GfxScreenManager* manager, struct GuiElement* elements, size_t count) {
+    if(manager->gsm_count >= GFX_MAX_SCREENS)
+        return -1;
+
+    GfxScreen* screen = manager->gsm_screens + manager->gsm_count;
+    memset(screen, 0, sizeof(GfxScreen));
+    screen->gsc_elements = elements;
+    screen->gsc_count = count;
+    return manager->gsm_count++;
+}
+
+// Operations of a hidden screen can still be rendering
+uint8_t gfx_screen_busy(GfxScreen* screen) {
+    for(size_t i = 0; i < screen->gsc_list.gdl_length; ++i) {
+        if(tft_operation_busy(screen->gsc_list.gdl_operations + i))
+            return 1;
+    }
+    return 0;
+}
+
+void gfx_screen_drop(GfxScreenManager* manager, GfxScreen* screen) {
+    gfx_delete_display_list(screen->gsc_list);
+    memset(&screen->gsc_list, 0, sizeof(GfxDisplayList));
+    manager->gsm_used -= screen->gsc_size;
+    screen->gsc_size = 0;
+    screen->gsc_built = 0;
+}
+
+/**
+ * @brief Evict screens
+ * Frees the least recently shown screens until the cache fits into
+ * the budget, the kept screen and screens which are still being
+ * rendered are never freed.
+ */
+void gfx_screens_evict(GfxScreenManager* manager, GfxScreen* keep) {
+    while(manager->gsm_used > manager->gsm_budget) {
+        GfxScreen* oldest = 0;
+        for(size_t i = 0; i < manager->gsm_count; ++i) {
+            GfxScreen* screen = manager->gsm_screens + i;
+            if(screen == keep || !screen->gsc_built || gfx_screen_busy(screen))
+                continue;
+            if(!oldest || screen->gsc_lastUsed < oldest->gsc_lastUsed)
+                oldest = screen;
+        }
+
+        if(!oldest)
+            return;
+        gfx_screen_drop(manager, oldest);
+    }
+}
+
+uint8_t gfx_screen_show(GfxScreenManager* manager, int index) {
+    if(index < 0 || (size_t)index >= manager->gsm_count)
+        return 0;
+
+    GfxScreen* screen = manager->gsm_screens + index;
+    const uint8_t cached = screen->gsc_built;
+    if(!cached) {
+        // Compiled before hiding, a tree nested too deep keeps the current screen
+        GfxDisplayList list = gfx_compile_display_list(screen->gsc_elements, screen->gsc_count);
+        if(!list.gdl_eventList)
+            return 0;
+        screen->gsc_list = list;
+        screen->gsc_size = gfx_display_list_size(&screen->gsc_list);
+        screen->gsc_built = 1;
+        manager->gsm_used += screen->gsc_size;
+    }
+
+    if(manager->gsm_active >= 0)
+        gfx_display_list_hide(&manager->gsm_screens[manager->gsm_active].gsc_list);
+
+    if(!cached) {
+        gfx_screens_evict(manager, screen);
+    } else {
+        // Only what changed while the screen was hidden is regenerated
+        gfx_display_list_refresh(&screen->gsc_list);
+    }
+
+    // Touches from now on go to the new screen
+    gfx_touch_reset();
+    gfx_activate_event_list(screen->gsc_list.gdl_eventList);
+
+    struct LcdOperation* op = &manager->gsm_scrollOp;
+    tft_cancel(op);
+    op->lo_op = SCROLL;
+    op->lo_static = 1;
+    op->lo_scroll.top = 0;
+    op->lo_scroll.height = TFT_HEIGHT;
+    op->lo_scroll.start = 0;
+    tft_submit(op);
+
+    gfx_display_list_submit(&screen->gsc_list);
+    tft_start_render();
+
+    screen->gsc_lastUsed = ++manager->gsm_clock;
+    manager->gsm_active = index;
+    return 1;
+}
+
+void gfx_screen_update(GfxScreenManager* manager) {
+    if(manager->gsm_active < 0)
+        return;
+    gfx_display_list_update_dirty(&manager->gsm_screens[manager->gsm_active].gsc_list);
+}
+
+void gfx_screens_free(GfxScreenManager* manager) {
+    if(manager->gsm_active >= 0)
+        gfx_activate_event_list(0);
+
+    for(size_t i = 0; i < manager->gsm_count; ++i) {
+        if(manager->gsm_screens[i].gsc_built)
+            gfx_screen_drop(manager, manager->gsm_screens + i);
+    }
+    manager->gsm_active = -1;
+}
@@ -0,0 +1,346 @@
+#ifndef MODULES_GFX_STATIC_HPP
+#define MODULES_GFX_STATIC_HPP
+
+#include "gfx.h"
+
+/**
+ * Compile-time layout
+ * Builds the LCD operations and touch regions of a constexpr GuiElement
+ * tree (described with the usual GUI_* macros) during compilation.
+ * The result is a constant which ends up in flash, so a static screen
+ * doesn't cost any RAM and building it doesn't cost any CPU time.
+ *
+ *   constexpr GuiElement children[] = { ... };
+ *   constexpr GuiElement root = GUI_BOX_STATIC(0, 0, 320, 480, TFT_BLACK, children);
+ *
+ *   GFX_STATIC_SCREEN(splash_screen, &root, 1);
+ *
+ *   splash_screen.submit();
+ *   splash_screen.activate();
+ *   tft_start_render();
+ *
+ * The produced operations are the same as gfx_create_render_chain() would
+ * create for the tree. Value elements need RAM and can't be used here.
+ */
+
+namespace gfx {
+
+template<size_t OpCount, size_t HitCount>
+struct StaticScreen {
+    LcdOperation ss_operations[OpCount];
+    // Arrays can't have a length of zero
+    GfxHitRegion ss_hitRegions[HitCount > 0 ? HitCount : 1];
+
+    void submit() const {
+        tft_submit_const(ss_operations, OpCount);
+    }
+
+    void activate() const {
+        gfx_activate_hit_table(ss_hitRegions, HitCount);
+    }
+};
+
+struct StaticContext {
+    uint16_t sc_x;
+    uint16_t sc_y;
+
+    uint16_t sc_prevWidth;
+    uint16_t sc_prevHeight;
+
+    LcdColor sc_prevColor;
+};
+
+// Not constexpr, calling it makes the layout fail to compile
+void unsupported_element();
+
+constexpr StaticContext base_context() {
+    return StaticContext { 0, 0, TFT_WIDTH, TFT_HEIGHT, TFT_BLACK };
+}
+
+constexpr int16_t decode_position(uint16_t encoded, const StaticContext& ctx) {
+    int16_t numberPart = encoded & POSITION_NUMBER_PART;
+    if(encoded & POSITION_SIGN_BIT) {
+        // Sign bit set, negate the number
+        numberPart |= ~POSITION_NUMBER_PART;
+    }
+
+    switch(encoded & RELATIVE_TO_MASK) {
+        case RELATIVE_TO_WIDTH:
+            return ctx.sc_prevWidth + numberPart;
+        case RELATIVE_TO_HEIGHT:
+            return ctx.sc_prevHeight + numberPart;
+        case 0x0000:
+        case RELATIVE_TO_MASK:
+            return numberPart;
+        default:
+            return 0;
+    }
+}
+
+constexpr size_t text_length(const char* text, const BitmapFont* font) {
+    size_t len = 0;
+    for(const char* c = text; *c; ++c) {
+        if(*c < font->bf_firstChar || *c > font->bf_lastChar)
+            continue;
+        len += font->bf_glyphs[*c - font->bf_firstChar].bfg_xAdvance;
+    }
+    return len;
+}
+
+/********** Counting **********/
+
+constexpr size_t count_ops(const GuiElement* elements, size_t count) {
+    size_t ops = 0;
+    for(size_t i = 0; i < count; ++i) {
+        const GuiElement& element = elements[i];
+        switch(element.ge_type) {
+            case GFX_BOX:
+                ops += 1 + count_ops(element.ge_box.ge_children, element.ge_box.ge_childrenCount);
+                break;
+            case GFX_TEXT:
+            case GFX_IMAGE_BUTTON:
+            case GFX_IMAGE:
+            case GFX_GRADIENT:
+            case GFX_SHAPE:
+                ops += 1;
+                break;
+            case GFX_BUTTON:
+                ops += 2;
+                break;
+            case GFX_BORDER:
+                ops += 4;
+                break;
+            default:
+                unsupported_element();
+        }
+    }
+    return ops;
+}
+
+constexpr size_t count_hit_regions(const GuiElement* elements, size_t count) {
+    size_t regions = 0;
+    for(size_t i = 0; i < count; ++i) {
+        const GuiElement& element = elements[i];
+        if(element.ge_type == GFX_BOX)
+            regions += count_hit_regions(element.ge_box.ge_children, element.ge_box.ge_childrenCount);
+        else if(element.ge_type == GFX_BUTTON && element.ge_button.ge_clickCallback)
+            ++regions;
+        else if(element.ge_type == GFX_IMAGE_BUTTON && element.ge_img_button.ge_clickCallback)
+            ++regions;
+    }
+    return regions;
+}
+
+/********** Operation builders **********/
+
+constexpr LcdOperation rect_fill(uint16_t x, uint16_t y, uint16_t width, uint16_t height, LcdColor color) {
+    return LcdOperation {
+        .lo_op = RECT_FILL, .lo_fg = color, .lo_bg = color,
+        .lo_static = 1, .lo_queued = 0, .lo_next = nullptr,
+        .lo_x = x, .lo_y = y,
+        .lo_rect = { width, height } };
+}
+
+constexpr LcdOperation text(uint16_t x, uint16_t y, LcdColor fg, LcdColor bg, const char* value, const BitmapFont* font) {
+    return LcdOperation {
+        .lo_op = TEXT, .lo_fg = fg, .lo_bg = bg,
+        .lo_static = 1, .lo_queued = 0, .lo_next = nullptr,
+        .lo_x = x, .lo_y = y,
+        .lo_text = { value, font } };
+}
+
+constexpr LcdOperation bitmap(LcdOperationEnum op, uint16_t x, uint16_t y, LcdColor fg, LcdColor bg, uint16_t width, uint16_t height, const void* data, uint8_t scale,
+                              const LcdColor* palette = nullptr, uint8_t bpp = 0) {
+    return LcdOperation {
+        .lo_op = op, .lo_fg = fg, .lo_bg = bg,
+        .lo_static = 1, .lo_queued = 0, .lo_next = nullptr,
+        .lo_x = x, .lo_y = y,
+        .lo_bitmap = { width, height, data, scale, palette, bpp } };
+}
+
+constexpr LcdOperation gradient(LcdOperationEnum op, uint16_t x, uint16_t y, uint16_t width, uint16_t height, LcdColor from, LcdColor to) {
+    return LcdOperation {
+        .lo_op = op, .lo_fg = from, .lo_bg = to,
+        .lo_static = 1, .lo_queued = 0, .lo_next = nullptr,
+        .lo_x = x, .lo_y = y,
+        .lo_gradient = { width, height, 0, 0 } };
+}
+
+constexpr LcdOperation shape(LcdOperationEnum op, uint16_t x, uint16_t y, uint16_t width, uint16_t height, LcdColor fg, LcdColor bg,
+                             int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t radius, uint8_t thickness) {
+    return LcdOperation {
+        .lo_op = op, .lo_fg = fg, .lo_bg = bg,
+        .lo_static = 1, .lo_queued = 0, .lo_next = nullptr,
+        .lo_x = x, .lo_y = y,
+        .lo_shape = { width, height, x0, y0, x1, y1, radius, thickness, 0, 0 } };
+}
+
+/********** Layout **********/
+
+template<size_t OpCount, size_t HitCount>
+struct Builder {
+    StaticScreen<OpCount, HitCount> b_screen;
+    size_t b_op;
+    size_t b_hit;
+
+    constexpr void emit(const LcdOperation& op) {
+        b_screen.ss_operations[b_op++] = op;
+    }
+
+    constexpr void hit_region(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint16_t contentX, uint16_t contentY, callback_t* callback, const GuiElement* element) {
+        b_screen.ss_hitRegions[b_hit++] = GfxHitRegion { x, y, width, height, contentX, contentY, callback, element };
+    }
+
+    constexpr void handle_box(const GuiElement& element, const StaticContext& ctx) {
+        StaticContext ctxNew {
+            (uint16_t)(decode_position(element.ge_x, ctx) + ctx.sc_x),
+            (uint16_t)(decode_position(element.ge_y, ctx) + ctx.sc_y),
+            (uint16_t)decode_position(element.ge_width, ctx),
+            (uint16_t)decode_position(element.ge_height, ctx),
+            element.ge_color };
+
+        emit(rect_fill(ctxNew.sc_x, ctxNew.sc_y, ctxNew.sc_prevWidth, ctxNew.sc_prevHeight, element.ge_color));
+
+        for(size_t i = 0; i < element.ge_box.ge_childrenCount; ++i)
+            handle_element(element.ge_box.ge_children[i], ctxNew);
+    }
+
+    constexpr void handle_text(const GuiElement& element, const StaticContext& ctx) {
+        uint16_t x = decode_position(element.ge_x, ctx) + ctx.sc_x;
+        uint16_t y = decode_position(element.ge_y, ctx) + ctx.sc_y;
+        size_t len = text_length(element.ge_text.ge_text, element.ge_text.ge_font);
+
+        if(element.ge_text.ge_textAlign == ALIGN_CENTER) {
+            size_t width = decode_position(element.ge_width, ctx);
+            if(len < width)
+                x += (width - len) / 2;
+        } else if(element.ge_text.ge_textAlign == ALIGN_RIGHT) {
+            x -= len;
+        }
+
+        emit(text(x, y, element.ge_color, ctx.sc_prevColor, element.ge_text.ge_text, element.ge_text.ge_font));
+    }
+
+    constexpr void handle_button(const GuiElement& element, const StaticContext& ctx) {
+        uint16_t x = decode_position(element.ge_x, ctx) + ctx.sc_x;
+        uint16_t y = decode_position(element.ge_y, ctx) + ctx.sc_y;
+        uint16_t width = decode_position(element.ge_width, ctx);
+        uint16_t height = decode_position(element.ge_height, ctx);
+
+        emit(rect_fill(x, y, width, height, element.ge_color));
+
+        uint16_t textX = x;
+        uint16_t textY = y;
+        size_t len = text_length(element.ge_button.ge_text, element.ge_button.ge_font);
+
+        if(element.ge_button.ge_textAlign == ALIGN_CENTER) {
+            if(len < width)
+                textX += (width - len) / 2;
+        } else if(element.ge_button.ge_textAlign == ALIGN_RIGHT) {
+            textX = x + width - len;
+        }
+
+        if(element.ge_button.ge_font->bf_yAdvance < height)
+            textY += (height - element.ge_button.ge_font->bf_yAdvance) / 2;
+
+        emit(text(textX, textY, element.ge_button.ge_textColor, element.ge_color, element.ge_button.ge_text, element.ge_button.ge_font));
+
+        if(element.ge_button.ge_clickCallback)
+            hit_region(x, y, width, height, textX, textY, element.ge_button.ge_clickCallback, &element);
+    }
+
+    constexpr void handle_border(const GuiElement& element, const StaticContext& ctx) {
+        uint16_t x = decode_position(element.ge_x, ctx) + ctx.sc_x;
+        uint16_t y = decode_position(element.ge_y, ctx) + ctx.sc_y;
+        uint16_t w = decode_position(element.ge_width, ctx);
+        uint16_t h = decode_position(element.ge_height, ctx);
+        uint8_t thickness = element.ge_border.ge_borderThickness;
+
+        emit(rect_fill(x, y, w, thickness, element.ge_color));
+        emit(rect_fill(x, y + h - thickness, w, thickness, element.ge_color));
+        emit(rect_fill(x, y, thickness, h, element.ge_color));
+        emit(rect_fill(x + w - thickness, y, thickness, h, element.ge_color));
+    }
+
+    constexpr void handle_image_button(const GuiElement& element, const StaticContext& ctx) {
+        uint16_t x = decode_position(element.ge_x, ctx) + ctx.sc_x;
+        uint16_t y = decode_position(element.ge_y, ctx) + ctx.sc_y;
+        uint16_t width = decode_position(element.ge_width, ctx);
+        uint16_t height = decode_position(element.ge_height, ctx);
+        uint8_t scale = element.ge_img_button.ge_imageScale;
+
+        emit(bitmap(element.ge_img_button.ge_rle ? RLE_BITMAP : BITMAP, x, y,
+                    element.ge_img_button.ge_fgColor, element.ge_color,
+                    width / scale, height / scale, element.ge_img_button.ge_bitmap, scale));
+
+        if(element.ge_img_button.ge_clickCallback)
+            hit_region(x, y, width, height, x, y, element.ge_img_button.ge_clickCallback, &element);
+    }
+
+    constexpr void handle_image(const GuiElement& element, const StaticContext& ctx) {
+        uint16_t x = decode_position(element.ge_x, ctx) + ctx.sc_x;
+        uint16_t y = decode_position(element.ge_y, ctx) + ctx.sc_y;
+        uint8_t scale = element.ge_image.ge_imageScale ? element.ge_image.ge_imageScale : 1;
+
+        emit(bitmap(element.ge_image.ge_format, x, y, element.ge_color, ctx.sc_prevColor,
+                    decode_position(element.ge_width, ctx) / scale, decode_position(element.ge_height, ctx) / scale,
+                    element.ge_image.ge_bitmap, scale, element.ge_image.ge_palette, element.ge_image.ge_bpp));
+    }
+
+    constexpr void handle_gradient(const GuiElement& element, const StaticContext& ctx) {
+        uint16_t x = decode_position(element.ge_x, ctx) + ctx.sc_x;
+        uint16_t y = decode_position(element.ge_y, ctx) + ctx.sc_y;
+
+        emit(gradient(element.ge_gradient.ge_direction == GRADIENT_HORIZONTAL ? HGRADIENT_FILL : VGRADIENT_FILL, x, y,
+                      decode_position(element.ge_width, ctx), decode_position(element.ge_height, ctx),
+                      element.ge_color, element.ge_gradient.ge_toColor));
+    }
+
+    constexpr void handle_shape(const GuiElement& element, const StaticContext& ctx) {
+        uint16_t x = decode_position(element.ge_x, ctx) + ctx.sc_x;
+        uint16_t y = decode_position(element.ge_y, ctx) + ctx.sc_y;
+
+        emit(shape(element.ge_shape.ge_kind, x, y, decode_position(element.ge_width, ctx), decode_position(element.ge_height, ctx),
+                   element.ge_color, ctx.sc_prevColor, element.ge_shape.ge_x0, element.ge_shape.ge_y0,
+                   element.ge_shape.ge_x1, element.ge_shape.ge_y1, element.ge_shape.ge_radius, element.ge_shape.ge_thickness));
+    }
+
+    constexpr void handle_element(const GuiElement& element, const StaticContext& ctx) {
+        switch(element.ge_type) {
+            case GFX_BOX: handle_box(element, ctx); break;
+            case GFX_TEXT: handle_text(element, ctx); break;
+            case GFX_BUTTON: handle_button(element, ctx); break;
+            case GFX_BORDER: handle_border(element, ctx); break;
+            case GFX_IMAGE_BUTTON: handle_image_button(element, ctx); break;
+            case GFX_IMAGE: handle_image(element, ctx); break;
+            case GFX_GRADIENT: handle_gradient(element, ctx); break;
+            case GFX_SHAPE: handle_shape(element, ctx); break;
+            default: unsupported_element();
+        }
+    }
+};
+
+template<size_t OpCount, size_t HitCount>
+constexpr StaticScreen<OpCount, HitCount> compile(const GuiElement* elements, size_t count) {
+    Builder<OpCount, HitCount> builder {};
+    for(size_t i = 0; i < count; ++i)
+        builder.handle_element(elements[i], base_context());
+    return builder.b_screen;
+}
+
+}
+
+/**
+ * @brief Define a static screen
+ * Declares a constexpr gfx::StaticScreen built from the given elements.
+ *
+ * @param name Name of the screen variable
+ * @param elements Pointer to constexpr root elements
+ * @param count Number of root elements
+ */
+#define GFX_STATIC_SCREEN(name, elements, count) \
+    constexpr auto name = gfx::compile< \
+        gfx::count_ops((elements), (count)), \
+        gfx::count_hit_regions((elements), (count))>((elements), (count))
+
+#endif
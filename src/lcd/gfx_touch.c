@@ -0,0 +1,356 @@
+#include "gfx.h"
+
+#include <string.h>
+
+#define GRID_COLUMNS ((TFT_WIDTH + GFX_TOUCH_CELL_SIZE - 1) / GFX_TOUCH_CELL_SIZE)
+#define GRID_ROWS ((TFT_HEIGHT + GFX_TOUCH_CELL_SIZE - 1) / GFX_TOUCH_CELL_SIZE)
+#define GRID_CELLS (GRID_COLUMNS * GRID_ROWS)
+
+#define INITIAL_CAPACITY 32
+// Every cell has a bit for every region slot
+#define CELL_WORDS(index) ((index)->gti_capacity / 32)
+
+GfxTouchIndex* gfx_touchIndex = 0;
+// Chain which owns the active touch index
+GfxChainHandle* gfx_activeChain = 0;
+const GfxHitRegion* gfx_hitTable = 0;
+size_t gfx_hitTableLength = 0;
+
+// List which is being dragged
+GfxList* gfx_draggedList = 0;
+
+void gfx_list_touch(GfxList* list, uint16_t y);
+void gfx_list_drag(GfxList* list, uint16_t y);
+void gfx_list_release(GfxList* list);
+
+// Pressed and released state of the touched button, rendered through the priority lane
+struct LcdOperation gfx_pressedOps[2];
+struct LcdOperation gfx_releasedOps[2];
+GfxHitRegion gfx_pressedRegion;
+uint8_t gfx_pressed = 0;
+
+/**
+ * @brief Get grid cells covered by a region
+ *
+ * @return uint8_t 0 if the region doesn't cover any cell
+ */
+uint8_t gfx_touch_cells(const GfxHitRegion* region, uint16_t* col0, uint16_t* col1, uint16_t* row0, uint16_t* row1) {
+    if(!region->ghr_width || !region->ghr_height || region->ghr_x >= TFT_WIDTH || region->ghr_y >= TFT_HEIGHT)
+        return 0;
+
+    uint32_t right = region->ghr_x + region->ghr_width - 1;
+    uint32_t bottom = region->ghr_y + region->ghr_height - 1;
+    if(right >= TFT_WIDTH)
+        right = TFT_WIDTH - 1;
+    if(bottom >= TFT_HEIGHT)
+        bottom = TFT_HEIGHT - 1;
+
+    *col0 = region->ghr_x / GFX_TOUCH_CELL_SIZE;
+    *col1 = right / GFX_TOUCH_CELL_SIZE;
+    *row0 = region->ghr_y / GFX_TOUCH_CELL_SIZE;
+    *row1 = bottom / GFX_TOUCH_CELL_SIZE;
+    return 1;
+}
+
+void gfx_touch_mark(GfxTouchIndex* index, size_t slot, uint8_t set) {
+    uint16_t col0, col1, row0, row1;
+    if(!gfx_touch_cells(index->gti_regions + slot, &col0, &col1, &row0, &row1))
+        return;
+
+    size_t words = CELL_WORDS(index);
+    uint32_t mask = 1UL << (slot % 32);
+
+    for(uint16_t row = row0; row <= row1; ++row) {
+        for(uint16_t col = col0; col <= col1; ++col) {
+            uint32_t* word = index->gti_cells + (row * GRID_COLUMNS + col) * words + slot / 32;
+            if(set)
+                *word |= mask;
+            else
+                *word &= ~mask;
+        }
+    }
+}
+
+/**
+ * @brief Double the number of region slots
+ * The grid has to be rebuilt since every cell gets more bits.
+ */
+void gfx_touch_grow(GfxTouchIndex* index) {
+    size_t oldCapacity = index->gti_capacity;
+    index->gti_capacity *= 2;
+
+    index->gti_regions = realloc(index->gti_regions, sizeof(GfxHitRegion) * index->gti_capacity);
+    memset(index->gti_regions + oldCapacity, 0, sizeof(GfxHitRegion) * oldCapacity);
+
+    free(index->gti_cells);
+    index->gti_cells = calloc(GRID_CELLS * CELL_WORDS(index), sizeof(uint32_t));
+
+    for(size_t i = 0; i < oldCapacity; ++i) {
+        if(index->gti_regions[i].ghr_callback)
+            gfx_touch_mark(index, i, 1);
+    }
+}
+
+GfxTouchIndex* gfx_create_touch_index() {
+    GfxTouchIndex* index = malloc(sizeof(GfxTouchIndex));
+    index->gti_capacity = INITIAL_CAPACITY;
+    index->gti_count = 0;
+    index->gti_regions = calloc(INITIAL_CAPACITY, sizeof(GfxHitRegion));
+    index->gti_cells = calloc(GRID_CELLS * CELL_WORDS(index), sizeof(uint32_t));
+    return index;
+}
+
+void gfx_delete_touch_index(GfxTouchIndex* index) {
+    if(!index)
+        return;
+    if(gfx_touchIndex == index)
+        gfx_touchIndex = 0;
+
+    free(index->gti_regions);
+    free(index->gti_cells);
+    free(index);
+}
+
+void gfx_touch_index_set(GfxTouchIndex* index, struct GuiElement* element, const GfxHitRegion* newRegion) {
+    callback_t* callback = newRegion->ghr_callback;
+
+    size_t slot = index->gti_capacity;
+    size_t freeSlot = index->gti_capacity;
+
+    for(size_t i = 0; i < index->gti_capacity; ++i) {
+        if(index->gti_regions[i].ghr_callback && index->gti_regions[i].ghr_element == element) {
+            slot = i;
+            break;
+        }
+        if(!index->gti_regions[i].ghr_callback && freeSlot == index->gti_capacity)
+            freeSlot = i;
+    }
+
+    GfxHitRegion* region;
+    if(slot != index->gti_capacity) {
+        region = index->gti_regions + slot;
+
+        // Unchanged regions are the common case for updates
+        if(region->ghr_x == newRegion->ghr_x && region->ghr_y == newRegion->ghr_y &&
+           region->ghr_width == newRegion->ghr_width && region->ghr_height == newRegion->ghr_height &&
+           region->ghr_contentX == newRegion->ghr_contentX && region->ghr_contentY == newRegion->ghr_contentY &&
+           region->ghr_callback == callback)
+            return;
+
+        gfx_touch_mark(index, slot, 0);
+        if(!callback) {
+            memset(region, 0, sizeof(GfxHitRegion));
+            --index->gti_count;
+            return;
+        }
+    } else {
+        if(!callback)
+            return;
+
+        if(freeSlot == index->gti_capacity)
+            gfx_touch_grow(index);
+
+        slot = freeSlot;
+        region = index->gti_regions + slot;
+        ++index->gti_count;
+    }
+
+    memcpy(region, newRegion, sizeof(GfxHitRegion));
+    region->ghr_element = element;
+    gfx_touch_mark(index, slot, 1);
+}
+
+size_t gfx_touch_index_size(const GfxTouchIndex* index) {
+    if(!index)
+        return 0;
+    return sizeof(GfxTouchIndex) + sizeof(GfxHitRegion) * index->gti_capacity + sizeof(uint32_t) * GRID_CELLS * CELL_WORDS(index);
+}
+
+const GfxHitRegion* gfx_touch_index_find(const GfxTouchIndex* index, uint16_t x, uint16_t y) {
+    if(x >= TFT_WIDTH || y >= TFT_HEIGHT)
+        return 0;
+
+    size_t words = CELL_WORDS(index);
+    const uint32_t* cell = index->gti_cells + ((y / GFX_TOUCH_CELL_SIZE) * GRID_COLUMNS + x / GFX_TOUCH_CELL_SIZE) * words;
+
+    for(size_t w = 0; w < words; ++w) {
+        uint32_t bits = cell[w];
+        while(bits) {
+            const GfxHitRegion* region = index->gti_regions + w * 32 + __builtin_ctz(bits);
+            if(x >= region->ghr_x && y >= region->ghr_y && x < region->ghr_x + region->ghr_width && y < region->ghr_y + region->ghr_height)
+                return region;
+
+            // Clear the lowest bit
+            bits &= bits - 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Reset touch state
+ * Forgets the pressed button and the dragged list, their feedback
+ * must not be drawn once a different screen is shown.
+ */
+void gfx_touch_reset() {
+    gfx_pressed = 0;
+    gfx_draggedList = 0;
+    for(size_t i = 0; i < 2; ++i) {
+        tft_cancel(gfx_pressedOps + i);
+        tft_cancel(gfx_releasedOps + i);
+    }
+}
+
+void gfx_release_active_chain() {
+    GfxChainHandle* handle = gfx_activeChain;
+    gfx_activeChain = 0;
+    gfx_chain_release(handle);
+}
+
+void gfx_activate_event_list(void* eventList) {
+    gfx_release_active_chain();
+    gfx_touchIndex = eventList;
+    gfx_hitTable = 0;
+    gfx_hitTableLength = 0;
+}
+
+void gfx_activate_hit_table(const GfxHitRegion* regions, size_t count) {
+    gfx_release_active_chain();
+    gfx_touchIndex = 0;
+    gfx_hitTable = regions;
+    gfx_hitTableLength = count;
+}
+
+void gfx_chain_activate(GfxChainHandle* handle) {
+    // Retain first, the handle could be the active one already
+    gfx_chain_retain(handle);
+    gfx_activate_event_list(handle->gch_chain.grc_eventList);
+    gfx_activeChain = handle;
+}
+
+/**
+ * @brief Create button state operations
+ * Generates the operations which draw a button (or an image button)
+ * in the pressed or normal state, pressed buttons have swapped colors.
+ *
+ * @param region Touch region of the button
+ * @param ops Output operations, at least 2
+ * @param pressed Pressed state
+ * @return size_t Number of generated operations
+ */
+size_t gfx_button_state_ops(const GfxHitRegion* region, struct LcdOperation* ops, uint8_t pressed) {
+    const struct GuiElement* element = region->ghr_element;
+
+    for(size_t i = 0; i < 2; ++i) {
+        ops[i].lo_static = 1;
+        ops[i].lo_queued = 0;
+        ops[i].lo_next = 0;
+    }
+
+    switch(element->ge_type) {
+        case GFX_BUTTON: {
+            LcdColor bg = pressed ? element->ge_button.ge_textColor : element->ge_color;
+            LcdColor fg = pressed ? element->ge_color : element->ge_button.ge_textColor;
+
+            ops[0].lo_op = RECT_FILL;
+            ops[0].lo_fg = bg;
+            ops[0].lo_x = region->ghr_x;
+            ops[0].lo_y = region->ghr_y;
+            ops[0].lo_rect.width = region->ghr_width;
+            ops[0].lo_rect.height = region->ghr_height;
+
+            ops[1].lo_op = TEXT;
+            ops[1].lo_fg = fg;
+            ops[1].lo_bg = bg;
+            ops[1].lo_x = region->ghr_contentX;
+            ops[1].lo_y = region->ghr_contentY;
+            ops[1].lo_text.value = element->ge_button.ge_text;
+            ops[1].lo_text.font = element->ge_button.ge_font;
+            return 2;
+        }
+        case GFX_IMAGE_BUTTON: {
+            uint8_t scale = element->ge_img_button.ge_imageScale;
+
+            ops[0].lo_op = element->ge_img_button.ge_rle ? RLE_BITMAP : BITMAP;
+            ops[0].lo_fg = pressed ? element->ge_color : element->ge_img_button.ge_fgColor;
+            ops[0].lo_bg = pressed ? element->ge_img_button.ge_fgColor : element->ge_color;
+            ops[0].lo_x = region->ghr_contentX;
+            ops[0].lo_y = region->ghr_contentY;
+            ops[0].lo_bitmap.bitmap = element->ge_img_button.ge_bitmap;
+            ops[0].lo_bitmap.width = region->ghr_width / scale;
+            ops[0].lo_bitmap.height = region->ghr_height / scale;
+            ops[0].lo_bitmap.scale = scale;
+            return 1;
+        }
+        default:
+            return 0;
+    }
+}
+
+void gfx_submit_state(struct LcdOperation* ops, size_t count) {
+    for(size_t i = 0; i < count; ++i)
+        tft_submit_priority(ops + i);
+    tft_start_render();
+}
+
+uint8_t gfx_state_busy(const struct LcdOperation* ops) {
+    return tft_operation_busy(ops) || tft_operation_busy(ops + 1);
+}
+
+void gfx_press(const GfxHitRegion* region) {
+    // Previous feedback is still queued or rendering, skip it this time
+    if(gfx_pressed || gfx_state_busy(gfx_pressedOps) || gfx_state_busy(gfx_releasedOps))
+        return;
+
+    memcpy(&gfx_pressedRegion, region, sizeof(GfxHitRegion));
+    gfx_pressed = 1;
+    gfx_submit_state(gfx_pressedOps, gfx_button_state_ops(region, gfx_pressedOps, 1));
+}
+
+void tft_release_cb() {
+    if(gfx_draggedList) {
+        gfx_list_release(gfx_draggedList);
+        gfx_draggedList = 0;
+    }
+
+    if(!gfx_pressed)
+        return;
+
+    gfx_pressed = 0;
+    // Presses wait for all feedback, so this only guards against rewriting ops the driver reads
+    if(gfx_state_busy(gfx_releasedOps))
+        return;
+    gfx_submit_state(gfx_releasedOps, gfx_button_state_ops(&gfx_pressedRegion, gfx_releasedOps, 0));
+}
+
+void tft_touch_cb(uint16_t x, uint16_t y) {
+    const GfxHitRegion* region = 0;
+
+    if(gfx_touchIndex) {
+        region = gfx_touch_index_find(gfx_touchIndex, x, y);
+    } else {
+        for(size_t i = 0; i < gfx_hitTableLength; ++i) {
+            const GfxHitRegion* entry = gfx_hitTable + i;
+            if(x >= entry->ghr_x && y >= entry->ghr_y && x < entry->ghr_x + entry->ghr_width && y < entry->ghr_y + entry->ghr_height) {
+                region = entry;
+                break;
+            }
+        }
+    }
+
+    if(region && region->ghr_element->ge_type == GFX_LIST) {
+        // Lists follow the touch until it is released
+        gfx_draggedList = region->ghr_element->ge_list.ge_state;
+        gfx_list_touch(gfx_draggedList, y);
+    } else if(region) {
+        // Show the feedback before running the callback
+        gfx_press(region);
+        region->ghr_callback(region->ghr_element);
+    }
+}
+
+void tft_drag_cb(uint16_t x, uint16_t y) {
+    (void)x;
+    if(gfx_draggedList)
+        gfx_list_drag(gfx_draggedList, y);
+}
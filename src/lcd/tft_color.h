@@ -0,0 +1,142 @@
+#ifndef TFT_COLOR_H
+#define TFT_COLOR_H
+
+#include "tft_driver.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Fixed-point color math
+ * Color words are 5:6:5 (blue in the top bits, red in the bottom ones),
+ * green is used with all 6 bits. Factors are 8 bit fractions where 256
+ * is 1.0, 8 bit alphas (0 - 255) are mapped onto that range.
+ */
+
+#define TFT_RB_MASK 0x001F001FU
+#define TFT_G_MASK 0x07E0U
+
+// Red in the low halfword, blue in the high one, with room for an 8 bit multiply
+static inline uint32_t tft_color_rb(uint16_t word) {
+    return (word & 0x1F) | ((uint32_t)(word & 0xF800) << 5);
+}
+
+static inline uint16_t tft_color_from_rb(uint32_t rb, uint32_t g) {
+    return (rb & 0x1F) | ((rb >> 5) & 0xF800) | (g & TFT_G_MASK);
+}
+
+static inline uint16_t tft_alpha_factor(uint8_t alpha) {
+    return alpha + (alpha >> 7);
+}
+
+/**
+ * @brief Scale color
+ *
+ * @param color Color
+ * @param factor Scale, 256 is 1.0
+ * @return LcdColor Scaled color (rounded down)
+ */
+static inline LcdColor tft_color_scale(LcdColor color, uint16_t factor) {
+    uint32_t rb = (tft_color_rb(color.word) * factor) >> 8;
+    uint32_t g = ((uint32_t)(color.word & TFT_G_MASK) * factor) >> 8;
+
+    LcdColor result = { tft_color_from_rb(rb, g) };
+    return result;
+}
+
+/**
+ * @brief Blend colors with 8 bit alpha
+ *
+ * @param fg Foreground color
+ * @param bg Background color
+ * @param alpha Foreground opacity, 255 is opaque
+ * @return LcdColor Blended color (rounded to nearest)
+ */
+static inline LcdColor tft_blend_a8(LcdColor fg, LcdColor bg, uint8_t alpha) {
+    const uint32_t a = tft_alpha_factor(alpha);
+    const uint32_t na = 256 - a;
+
+    uint32_t rb = (tft_color_rb(fg.word) * a + tft_color_rb(bg.word) * na + 0x00800080U) >> 8;
+    uint32_t g = ((uint32_t)(fg.word & TFT_G_MASK) * a + (uint32_t)(bg.word & TFT_G_MASK) * na + (0x80 << 5)) >> 8;
+
+    LcdColor result = { tft_color_from_rb(rb, g) };
+    return result;
+}
+
+/**
+ * @brief Blend colors with 4 bit alpha
+ * Uses a single multiply on the whole color, made for anti-aliased glyph
+ * edges where 16 levels are enough.
+ *
+ * @param fg Foreground color
+ * @param bg Background color
+ * @param alpha Foreground opacity, 15 is opaque
+ * @return LcdColor Blended color (rounded down, green can be 2 steps off)
+ */
+static inline LcdColor tft_blend_a4(LcdColor fg, LcdColor bg, uint8_t alpha) {
+    // Green goes to the high halfword, leaving 5 spare bits above every channel
+    uint32_t f = (fg.word | ((uint32_t)fg.word << 16)) & 0x07E0F81FU;
+    uint32_t b = (bg.word | ((uint32_t)bg.word << 16)) & 0x07E0F81FU;
+    uint32_t a = (alpha * 17 + 4) >> 3;
+
+    uint32_t blended = ((((f - b) * a) >> 5) + b) & 0x07E0F81FU;
+
+    LcdColor result = { (uint16_t)(blended | (blended >> 16)) };
+    return result;
+}
+
+/**
+ * @brief Interpolate colors
+ *
+ * @param from Color at t = 0
+ * @param to Color at t = 255
+ * @param t Position
+ * @return LcdColor Interpolated color
+ */
+static inline LcdColor tft_color_lerp(LcdColor from, LcdColor to, uint8_t t) {
+    return tft_blend_a8(to, from, t);
+}
+
+/**
+ * @brief Blend two pixels with 8 bit alpha
+ * Packed variant for the rasterizers, both halfwords are separate pixels
+ * (like the pixel pairs written to the line buffer).
+ *
+ * @param fg Foreground pixel pair
+ * @param bg Background pixel pair
+ * @param alpha Foreground opacity, 255 is opaque
+ * @return uint32_t Blended pixel pair
+ */
+static inline uint32_t tft_blend2_a8(uint32_t fg, uint32_t bg, uint8_t alpha) {
+    const uint32_t a = tft_alpha_factor(alpha);
+    const uint32_t na = 256 - a;
+
+    // Every channel gets its own pair of 16 bit lanes
+    uint32_t r = ((fg & TFT_RB_MASK) * a + (bg & TFT_RB_MASK) * na + 0x00800080U) >> 8;
+    uint32_t g = (((fg >> 5) & 0x003F003FU) * a + ((bg >> 5) & 0x003F003FU) * na + 0x00800080U) >> 8;
+    uint32_t b = (((fg >> 11) & TFT_RB_MASK) * a + ((bg >> 11) & TFT_RB_MASK) * na + 0x00800080U) >> 8;
+
+    return (r & TFT_RB_MASK) | ((g & 0x003F003FU) << 5) | ((b & TFT_RB_MASK) << 11);
+}
+
+/**
+ * @brief Scale two pixels
+ *
+ * @param pair Pixel pair
+ * @param factor Scale, 256 is 1.0
+ * @return uint32_t Scaled pixel pair
+ */
+static inline uint32_t tft_scale2(uint32_t pair, uint16_t factor) {
+    uint32_t r = ((pair & TFT_RB_MASK) * factor) >> 8;
+    uint32_t g = (((pair >> 5) & 0x003F003FU) * factor) >> 8;
+    uint32_t b = (((pair >> 11) & TFT_RB_MASK) * factor) >> 8;
+
+    return (r & TFT_RB_MASK) | ((g & 0x003F003FU) << 5) | ((b & TFT_RB_MASK) << 11);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
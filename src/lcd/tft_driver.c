@@ -1,8 +1,11 @@
 #include "tft_driver.h"
+#include "tft_expand.h"
+#include "tft_color.h"
 
 #include <stm32f4xx_hal.h>
 #include <stm32f4xx_hal_spi.h>
 #include <stm32f4xx_hal_dma.h>
+#include <stm32f4xx_hal_crc.h>
 
 #include <stdlib.h>
 #include <string.h>
@@ -45,6 +48,46 @@
 
 #define SPI_WAIT_NBSY() while(__HAL_SPI_GET_FLAG(&tft_lcdSPI, SPI_FLAG_BSY))
 
+// The render queue is modified both from the main loop and the DMA interrupt
+#define QUEUE_LOCK() uint32_t __primask = __get_PRIMASK(); __disable_irq();
+#define QUEUE_UNLOCK() __set_PRIMASK(__primask);
+
+// Number of statically allocated operations used for continuing
+// operations that didn't fit into a single DMA transfer
+#define CONTINUATION_SLOTS 3
+
+// Largest fill (or color bitmap) sent in a single DMA transfer, priority
+// operations can only be started between transfers (8K pixels take ~12 ms)
+#ifndef LCD_FILL_CHUNK
+#define LCD_FILL_CHUNK 8 * 1024
+#endif
+
+// Composites are hashed in bands of this many rows
+#ifndef LCD_TILE_ROWS
+#define LCD_TILE_ROWS 16
+#endif
+
+// Number of remembered tile hashes
+#ifndef LCD_TILE_SLOTS
+#define LCD_TILE_SLOTS 64
+#endif
+
+// Maximum number of tiles sent by one transfer
+#define LCD_TILE_RUN 8
+
+// Unchanged tiles skipped before the rest of a composite is left to the main loop
+#ifndef LCD_TILE_SKIP_MAX
+#define LCD_TILE_SKIP_MAX 4
+#endif
+
+// Unchanged tiles are hashed from an aligned copy in chunks of this many words
+#define LCD_CRC_CHUNK 32
+
+// A held touch is read again after this many milliseconds (for dragging)
+#ifndef TP_DRAG_INTERVAL
+#define TP_DRAG_INTERVAL 20
+#endif
+
 //#include <Arduino.h>
 //#define LCD_DELAY(ms) delay((ms));
 #include <src/cnc.h>
@@ -72,19 +115,59 @@ const uint8_t TFT_TP_Sequence[] = { 0xD0, 0x00,  0xD0, 0x00,  0xD0, 0x00,  0xD0,
 /********** Global variables **********/
 SPI_HandleTypeDef tft_lcdSPI;
 DMA_HandleTypeDef tft_lcdDMA;
+CRC_HandleTypeDef tft_crc;
 
 uint8_t tft_rendering;
-
-uint16_t tft_lcdBuffer[LCD_BUFFER_SIZE]; // We'll allocate a 16K buffer for drawing things
+// The render stopped without a transfer, tft_main_loop() starts it again
+volatile uint8_t tft_renderYielded;
+
+// Last window set on the panel, unchanged coordinates are not sent again
+uint16_t tft_windowX0 = 0xFFFF, tft_windowX1 = 0xFFFF;
+uint16_t tft_windowY0 = 0xFFFF, tft_windowY1 = 0xFFFF;
+// Row the next pixel written into the current window lands on, if known
+uint16_t tft_windowCursorY = 0xFFFF;
+// Computed fill color, read by the DMA during a transfer
+LcdColor tft_fillColor;
+
+// Hash of an area last sent by a composite, free slots have a width of 0
+typedef struct TileHash_t {
+    uint16_t th_x;
+    uint16_t th_y;
+    uint16_t th_width;
+    uint16_t th_height;
+    uint32_t th_crc;
+} TileHash;
+
+TileHash tft_tileHashes[LCD_TILE_SLOTS];
+uint8_t tft_tileNext;
+LcdTileStats tft_tileStats;
+
+uint16_t tft_lcdBuffer[LCD_BUFFER_SIZE] __attribute__((aligned(4))); // We'll allocate a 16K buffer for drawing things
 
 struct LcdOperation* tft_lcdOperations = 0;
 struct LcdOperation* tft_lcdLastOp = 0;
+struct LcdOperation* tft_currentOp = 0;
+
+// Priority lane, always emptied before the normal queue
+struct LcdOperation* tft_priorityOps = 0;
+struct LcdOperation* tft_priorityLastOp = 0;
+// Set if the current operation came from the priority lane
+uint8_t tft_currentPriority = 0;
+
+struct LcdOperation tft_continuationOps[CONTINUATION_SLOTS];
+struct LcdOperation tft_arrayOp;
 
 uint8_t tft_tpHandled;
 uint8_t tft_tpPending;
+// Touch happened during a render, it is read at the next chunk boundary
+uint8_t tft_tpDeferred;
+// Touch was reported and the panel hasn't been released yet
+uint8_t tft_tpPressed;
 
 uint16_t tft_tpX;
 uint16_t tft_tpY;
+// Tick of the last read of a held touch
+uint32_t tft_tpDragTick;
 
 uint16_t tft_tpCalibrationData[4] = {
     3600, // x0 position
@@ -186,7 +269,8 @@ void tft_lcd_dma(const void* data, size_t length) {
 /**
  * @brief Set LCD write window
  * Prepares the LCD for writing image data by setting
- * the start and end positions
+ * the start and end positions, columns and rows which
+ * are the same as for the previous window are not sent.
  *
  * @param x0 Start column
  * @param y0 Start row
@@ -197,18 +281,37 @@ void tft_set_window(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1) {
     uint16_t data[4];
     memset(data, 0, sizeof(data));
 
-    data[0] = x0 >> 8;
-    data[1] = x0 & 0xFF;
-    data[2] = x1 >> 8;
-    data[3] = x1 & 0xFF;
-    tft_lcd_cmd_data(0x2A, data, sizeof(data));
+    if(x0 != tft_windowX0 || x1 != tft_windowX1) {
+        data[0] = x0 >> 8;
+        data[1] = x0 & 0xFF;
+        data[2] = x1 >> 8;
+        data[3] = x1 & 0xFF;
+        tft_lcd_cmd_data(0x2A, data, sizeof(data));
+
+        tft_windowX0 = x0;
+        tft_windowX1 = x1;
+    }
+
+    if(y0 != tft_windowY0 || y1 != tft_windowY1) {
+        data[0] = y0 >> 8;
+        data[1] = y0 & 0xFF;
+        data[2] = y1 >> 8;
+        data[3] = y1 & 0xFF;
+        tft_lcd_cmd_data(0x2B, data, sizeof(data));
+
+        tft_windowY0 = y0;
+        tft_windowY1 = y1;
+    }
 
-    data[0] = y0 >> 8;
-    data[1] = y0 & 0xFF;
-    data[2] = y1 >> 8;
-    data[3] = y1 & 0xFF;
-    tft_lcd_cmd_data(0x2B, data, sizeof(data));
+    // The area is going to be overwritten, hashes of tiles in it are stale
+    for(size_t i = 0; i < LCD_TILE_SLOTS; ++i) {
+        TileHash* tile = &tft_tileHashes[i];
+        if(tile->th_width && tile->th_x <= x1 && x0 < tile->th_x + tile->th_width &&
+           tile->th_y <= y1 && y0 < tile->th_y + tile->th_height)
+            tile->th_width = 0;
+    }
 
+    tft_windowCursorY = 0xFFFF;
     tft_lcd_cmd(0x2C);
 }
 
@@ -218,19 +321,66 @@ struct LcdOperation* tft_new_operation(LcdOperationEnum operation) {
     lop->lo_op = operation;
     lop->lo_next = 0;
     lop->lo_static = 0;
+    lop->lo_queued = 0;
 
     return lop;
 }
 
-void tft_submit(struct LcdOperation* op) {
-    if(!tft_lcdOperations) {
-        tft_lcdOperations = op;
-        tft_lcdLastOp = op;
+/**
+ * @brief Append operation to a queue
+ * Has to be called with the queue locked.
+ *
+ * @param first First operation of the queue
+ * @param last Last operation of the queue
+ * @param op Operation to append
+ */
+void tft_queue_append(struct LcdOperation** first, struct LcdOperation** last, struct LcdOperation* op) {
+    if(op->lo_queued)
+        return;
+
+    op->lo_queued = 1;
+    op->lo_next = 0;
+    if(!*first) {
+        *first = op;
+        *last = op;
     } else {
-        tft_lcdLastOp->lo_next = op;
-        tft_lcdLastOp = op;
+        (*last)->lo_next = op;
+        *last = op;
     }
-    op->lo_next = 0;
+}
+
+void tft_asset_operation(struct LcdOperation* op, const LcdAsset* asset, uint16_t x, uint16_t y, uint8_t scale) {
+    op->lo_op = asset->la_format;
+    op->lo_x = x;
+    op->lo_y = y;
+    if(asset->la_format == TEXT) {
+        op->lo_text.value = 0;
+        op->lo_text.font = asset->la_data;
+        return;
+    }
+
+    op->lo_bitmap.width = asset->la_width;
+    op->lo_bitmap.height = asset->la_height;
+    op->lo_bitmap.bitmap = asset->la_data;
+    op->lo_bitmap.scale = TFT_ASSET_SCALE(asset->la_format, scale);
+    op->lo_bitmap.palette = asset->la_palette;
+    op->lo_bitmap.bpp = asset->la_bpp;
+}
+
+void tft_submit(struct LcdOperation* op) {
+    QUEUE_LOCK();
+    tft_queue_append(&tft_lcdOperations, &tft_lcdLastOp, op);
+    QUEUE_UNLOCK();
+}
+
+uint8_t tft_operation_busy(const struct LcdOperation* op) {
+    return op->lo_queued || op == tft_currentOp;
+}
+
+void tft_submit_priority(struct LcdOperation* op) {
+    QUEUE_LOCK();
+    tft_queue_append(&tft_priorityOps, &tft_priorityLastOp, op);
+    QUEUE_UNLOCK();
 }
 
 void tft_submit_multiple(struct LcdOperation* ops, size_t count) {
@@ -242,31 +392,202 @@ void tft_submit_multiple(struct LcdOperation* ops, size_t count) {
     }
 }
 
+void tft_submit_callback(void (*function)(void* arg), void* arg) {
+    struct LcdOperation* op = tft_new_operation(CALLBACK);
+    op->lo_callback.function = function;
+    op->lo_callback.arg = arg;
+    tft_submit(op);
+}
+
+void tft_submit_const(const struct LcdOperation* ops, size_t count) {
+    struct LcdOperation* op = tft_new_operation(CONST_ARRAY);
+    op->lo_array.ops = ops;
+    op->lo_array.count = count;
+    op->lo_array.index = 0;
+    tft_submit(op);
+}
+
+/**
+ * @brief Remove operation from a queue
+ * Has to be called with the queue locked.
+ *
+ * @return uint8_t 1 if the operation was found and removed
+ */
+uint8_t tft_queue_remove(struct LcdOperation** first, struct LcdOperation** last, struct LcdOperation* op) {
+    struct LcdOperation* prev = 0;
+    for(struct LcdOperation* entry = *first; entry; prev = entry, entry = entry->lo_next) {
+        if(entry != op)
+            continue;
+
+        if(prev)
+            prev->lo_next = op->lo_next;
+        else
+            *first = op->lo_next;
+        if(*last == op)
+            *last = prev;
+
+        op->lo_queued = 0;
+        op->lo_next = 0;
+        return 1;
+    }
+    return 0;
+}
+
+int tft_cancel(struct LcdOperation* op) {
+    int result = 0;
+
+    QUEUE_LOCK();
+    if(op == tft_currentOp) {
+        result = -1;
+    } else if(op->lo_queued) {
+        if(tft_queue_remove(&tft_lcdOperations, &tft_lcdLastOp, op) || tft_queue_remove(&tft_priorityOps, &tft_priorityLastOp, op))
+            result = 1;
+    }
+    QUEUE_UNLOCK();
+
+    return result;
+}
+
 /**
- * @brief Insert operation after position
- * This function inserts a rendering operation after the
- * specified position in the render queue.
+ * @brief Insert operation at the front of the queue
+ * This function inserts a rendering operation so that it
+ * will be rendered right after the current one, it goes
+ * into the same lane as the current operation.
  *
- * @param position Position to insert after
  * @param op Operation to be inserted
  */
-void tft_insert_after(struct LcdOperation* position, struct LcdOperation* op) {
-    if(position == tft_lcdLastOp)
-        tft_lcdLastOp = op;
-    op->lo_next = position->lo_next;
-    position->lo_next = op;
+void tft_insert_next(struct LcdOperation* op) {
+    QUEUE_LOCK();
+    struct LcdOperation** first = tft_currentPriority ? &tft_priorityOps : &tft_lcdOperations;
+    struct LcdOperation** last = tft_currentPriority ? &tft_priorityLastOp : &tft_lcdLastOp;
+
+    op->lo_queued = 1;
+    op->lo_next = *first;
+    *first = op;
+    if(!*last)
+        *last = op;
+    QUEUE_UNLOCK();
+}
+
+/**
+ * @brief Take the next operation out of the queue
+ * Operations in the priority lane are taken first.
+ *
+ * @return struct LcdOperation* Next operation or 0 if the queue is empty
+ */
+struct LcdOperation* tft_pop_operation() {
+    QUEUE_LOCK();
+    struct LcdOperation* op;
+    if(tft_priorityOps) {
+        op = tft_priorityOps;
+        tft_priorityOps = op->lo_next;
+        if(!tft_priorityOps)
+            tft_priorityLastOp = 0;
+        tft_currentPriority = 1;
+    } else {
+        op = tft_lcdOperations;
+        if(op) {
+            tft_lcdOperations = op->lo_next;
+            if(!tft_lcdOperations)
+                tft_lcdLastOp = 0;
+        }
+        tft_currentPriority = 0;
+    }
+
+    if(op)
+        op->lo_queued = 0;
+    QUEUE_UNLOCK();
+    return op;
+}
+
+/**
+ * @brief Get the next operation to render
+ * Takes the next operation out of the queue, constant arrays
+ * are expanded one operation at a time and callbacks are called.
+ *
+ * @return struct LcdOperation* Next operation or 0 if the queue is empty
+ */
+struct LcdOperation* tft_next_operation() {
+    struct LcdOperation* op;
+    while((op = tft_pop_operation()) && (op->lo_op == CONST_ARRAY || op->lo_op == CALLBACK)) {
+        if(op->lo_op == CALLBACK) {
+            // The callback can free the operation, take everything out of it first
+            void (*function)(void*) = op->lo_callback.function;
+            void* arg = op->lo_callback.arg;
+            if(!op->lo_static)
+                free(op);
+
+            function(arg);
+            continue;
+        }
+
+        if(op->lo_array.index < op->lo_array.count) {
+            // Copy the operation into RAM and put the array back in front,
+            // continuations of the copy will be inserted before the array.
+            memcpy(&tft_arrayOp, op->lo_array.ops + op->lo_array.index++, sizeof(struct LcdOperation));
+            tft_arrayOp.lo_static = 1;
+            tft_arrayOp.lo_queued = 0;
+            tft_arrayOp.lo_next = 0;
+
+            tft_insert_next(op);
+            return &tft_arrayOp;
+        }
+
+        // Array is finished
+        if(!op->lo_static)
+            free(op);
+    }
+    return op;
+}
+
+/**
+ * @brief Create continuation operation
+ * Returns a statically allocated operation which can be used to
+ * continue the current operation, this way rendering large operations
+ * doesn't cause any heap allocations.
+ *
+ * @param operation LCD operation type
+ * @return struct LcdOperation* Pointer to operation struct
+ */
+struct LcdOperation* tft_new_continuation(LcdOperationEnum operation) {
+    for(size_t i = 0; i < CONTINUATION_SLOTS; ++i) {
+        struct LcdOperation* slot = &tft_continuationOps[i];
+        if(slot != tft_currentOp && !slot->lo_queued) {
+            slot->lo_op = operation;
+            slot->lo_next = 0;
+            slot->lo_static = 1;
+            return slot;
+        }
+    }
+
+    // All slots are taken, this shouldn't really happen
+    return tft_new_operation(operation);
 }
 
 
 /********** Start of rendering functions **********/
 
 void tft_render_op(struct LcdOperation* op);
+void tft_lcd_dma_complete();
+void tft_yield_render();
 
 #define LCD_ENCODE_COLOR(pos, color) {\
     size_t __pos = (pos); \
     tft_lcdBuffer[(__pos)] = (color).word; \
 }
 
+// Expands the current mask byte, whole bytes go through the 8 pixel kernel.
+// Needs `bits`, `mask`, `fgWord`, `bgWord`, `fgPair` and `bgPair`.
+#define EXPAND_PIXELS(out, x, width) \
+    if(mask == 0x80 && (width) - (x) >= 8) { \
+        tft_expand8((out) + (x), bits, fgPair, bgPair); \
+        (x) += 8; \
+        mask = 0; \
+    } else { \
+        (out)[(x)++] = (bits & mask) ? fgWord : bgWord; \
+        mask >>= 1; \
+    }
+
 void tft_render_text(struct LcdOperation* op) {
     const size_t lineHeight = op->lo_text.font->bf_yAdvance;
 
@@ -289,6 +610,11 @@ void tft_render_text(struct LcdOperation* op) {
             xMax = x;
     }
 
+    const uint16_t fgWord = op->lo_fg.word;
+    const uint16_t bgWord = op->lo_bg.word;
+    const uint32_t fgPair = TFT_PIXEL_PAIR(fgWord);
+    const uint32_t bgPair = TFT_PIXEL_PAIR(bgWord);
+
     size_t pixelsPerLine = xMax * lineHeight;
     size_t maxLines = LCD_BUFFER_SIZE / pixelsPerLine;
 
@@ -311,7 +637,7 @@ void tft_render_text(struct LcdOperation* op) {
 
             if(line > maxLines) {
                 // Submit a new text draw with remaining text
-                struct LcdOperation* cont = tft_new_operation(TEXT);
+                struct LcdOperation* cont = tft_new_continuation(TEXT);
                 cont->lo_fg = op->lo_fg;
                 cont->lo_bg = op->lo_bg;
                 cont->lo_x = op->lo_x;
@@ -319,7 +645,7 @@ void tft_render_text(struct LcdOperation* op) {
                 cont->lo_text.font = op->lo_text.font;
                 cont->lo_text.value = textPtr + 1;
 
-                tft_insert_after(op, cont);
+                tft_insert_next(cont);
                 break;
             }
             y += lineHeight;
@@ -362,18 +688,16 @@ void tft_render_text(struct LcdOperation* op) {
             }
 
             for(size_t yy = 0; yy < glyph.bfg_height; ++yy) {
-                for(size_t xx = 0; xx < glyph.bfg_width; ++xx) {
+                size_t yPos = y + yy + glyph.bfg_yOffset - FONT_Y_OFFSET;
+                uint16_t* out = tft_lcdBuffer + x + glyph.bfg_xOffset + yPos * xMax;
+
+                for(size_t xx = 0; xx < glyph.bfg_width;) {
                     if(!mask) {
                         mask = 0x80;
                         bits = op->lo_text.font->bf_bitmap[bitmapOffset++];
                     }
 
-                    LcdColor color = (bits & mask) ? op->lo_fg : op->lo_bg;
-                    mask >>= 1;
-
-                    size_t xPos = x + xx + glyph.bfg_xOffset;
-                    size_t yPos = y + yy + glyph.bfg_yOffset - FONT_Y_OFFSET;
-                    LCD_ENCODE_COLOR(xPos + yPos * xMax, color);
+                    EXPAND_PIXELS(out, xx, glyph.bfg_width)
                 }
             }
 
@@ -393,11 +717,75 @@ void tft_render_text(struct LcdOperation* op) {
     tft_lcd_dma(tft_lcdBuffer, xMax * y);
 }
 
+// Lets us store two pixels at once without breaking aliasing rules
+typedef uint32_t __attribute__((may_alias)) PixelPair;
+
+/**
+ * @brief Scale buffer row
+ * Stretches a row of `width` pixels (starting at the beginning of the
+ * output) horizontally in place and copies it into the next `scale - 1`
+ * rows. Scales 1 to 4 have their own kernels with constant strides,
+ * even scales store pixel pairs with a single write.
+ *
+ * @param out Row start, has to be 4 byte aligned for even scales
+ * @param width Source pixels
+ * @param scale Scale
+ */
+void tft_scale_row(uint16_t* out, size_t width, uint8_t scale) {
+    const size_t scaledWidth = width * scale;
+
+    // Going from the end, so the source pixels are read before they are overwritten
+    switch(scale) {
+        case 1:
+            return;
+        case 2:
+            for(size_t x = width; x-- > 0;) {
+                uint32_t pair = out[x] * 0x00010001U;
+                ((PixelPair*)out)[x] = pair;
+            }
+            break;
+        case 3:
+            for(size_t x = width; x-- > 0;) {
+                uint16_t word = out[x];
+                uint16_t* dst = out + x * 3;
+                dst[0] = word;
+                dst[1] = word;
+                dst[2] = word;
+            }
+            break;
+        case 4:
+            for(size_t x = width; x-- > 0;) {
+                uint32_t pair = out[x] * 0x00010001U;
+                PixelPair* dst = (PixelPair*)out + x * 2;
+                dst[0] = pair;
+                dst[1] = pair;
+            }
+            break;
+        default:
+            for(size_t x = width; x-- > 0;) {
+                uint16_t word = out[x];
+                for(size_t i = 0; i < scale; ++i)
+                    out[x * scale + i] = word;
+            }
+            break;
+    }
+
+    for(size_t i = 1; i < scale; ++i)
+        memcpy(out + i * scaledWidth, out, scaledWidth * sizeof(uint16_t));
+}
+
 #define READ_BYTE(source) ((uint8_t*)op->source.bitmap)[bitmapPos++]
 #define DO_BITMAP_RENDERING(source) \
-    size_t maxHeight = LCD_BUFFER_SIZE / (op->source.width * op->source.scale * op->source.scale); \
+    const uint8_t scale = op->source.scale; \
+    const size_t scaledWidth = op->source.width * scale; \
+    const uint16_t fgWord = op->lo_fg.word; \
+    const uint16_t bgWord = op->lo_bg.word; \
+    const uint32_t fgPair = TFT_PIXEL_PAIR(fgWord); \
+    const uint32_t bgPair = TFT_PIXEL_PAIR(bgWord); \
+    size_t maxHeight = LCD_BUFFER_SIZE / (scaledWidth * scale); \
     size_t processHeight = op->source.height; \
     uint8_t doContinue = 0; \
+    uint16_t* out = tft_lcdBuffer; \
 \
     if(processHeight > maxHeight) { \
         processHeight = maxHeight; \
@@ -405,37 +793,29 @@ void tft_render_text(struct LcdOperation* op) {
     } \
  \
     for(size_t y = 0; y < processHeight; ++y) { \
-        for(size_t x = 0; x < op->source.width; ++x) { \
+        for(size_t x = 0; x < op->source.width;) { \
             if(!mask) { \
                 bits = READ_BYTE(source); \
                 mask = 0x80; \
             } \
  \
-            LcdColor color = (bits & mask) ? op->lo_fg : op->lo_bg; \
-            mask >>= 1; \
- \
-            if(op->source.scale == 1) { \
-                LCD_ENCODE_COLOR(x + y * op->source.width, color); \
-            } else {\
-                for(size_t i = 0; i < op->source.scale; ++i) { \
-                    for(size_t j = 0; j < op->source.scale; ++j) { \
-                        LCD_ENCODE_COLOR((x * op->source.scale + i) + (y * op->source.scale + j) * (op->source.width * op->source.scale), color); \
-                    } \
-                } \
-            } \
+            EXPAND_PIXELS(out, x, op->source.width) \
         } \
+ \
+        tft_scale_row(out, op->source.width, scale); \
+        out += scaledWidth * scale; \
     } \
  \
-    tft_set_window(op->lo_x, op->lo_y, op->lo_x + (op->source.width * op->source.scale) - 1, op->lo_y + (processHeight * op->source.scale) - 1); \
+    tft_set_window(op->lo_x, op->lo_y, op->lo_x + scaledWidth - 1, op->lo_y + (processHeight * scale) - 1); \
     tft_dma_memmode(1); \
-    tft_lcd_dma(tft_lcdBuffer, op->source.width * processHeight * op->source.scale * op->source.scale); \
+    tft_lcd_dma(tft_lcdBuffer, scaledWidth * processHeight * scale); \
  \
     if(doContinue) { \
-        struct LcdOperation* contOp = tft_new_operation(BITMAP_CONTINUE); \
+        struct LcdOperation* contOp = tft_new_continuation(BITMAP_CONTINUE); \
         contOp->lo_fg = op->lo_fg; \
         contOp->lo_bg = op->lo_bg; \
         contOp->lo_x = op->lo_x; \
-        contOp->lo_y = op->lo_y + processHeight; \
+        contOp->lo_y = op->lo_y + processHeight * scale; \
         contOp->lo_bitmap_cont.width = op->source.width; \
         contOp->lo_bitmap_cont.height = op->source.height - processHeight; \
         contOp->lo_bitmap_cont.bitmap = op->source.bitmap; \
@@ -443,7 +823,7 @@ void tft_render_text(struct LcdOperation* op) {
         contOp->lo_bitmap_cont.mask = mask; \
         contOp->lo_bitmap_cont.bitmapOffset = bitmapPos; \
         contOp->lo_bitmap_cont.scale = op->source.scale; \
-        tft_insert_after(op, contOp); \
+        tft_insert_next(contOp); \
     }
 
 void tft_render_bitmap(struct LcdOperation* op) {
@@ -469,9 +849,16 @@ void tft_render_cont_bitmap(struct LcdOperation* op) {
 // 0xmm - Simple 1 byte data
 
 #define DO_RLE_BITMAP_RENDERING(source) \
-    size_t maxHeight = LCD_BUFFER_SIZE / (op->source.width * op->source.scale * op->source.scale); \
+    const uint8_t scale = op->source.scale; \
+    const size_t scaledWidth = op->source.width * scale; \
+    const uint16_t fgWord = op->lo_fg.word; \
+    const uint16_t bgWord = op->lo_bg.word; \
+    const uint32_t fgPair = TFT_PIXEL_PAIR(fgWord); \
+    const uint32_t bgPair = TFT_PIXEL_PAIR(bgWord); \
+    size_t maxHeight = LCD_BUFFER_SIZE / (scaledWidth * scale); \
     size_t processHeight = op->source.height; \
     uint8_t doContinue = 0; \
+    uint16_t* out = tft_lcdBuffer; \
  \
     if(processHeight > maxHeight) { \
         processHeight = maxHeight; \
@@ -479,7 +866,7 @@ void tft_render_cont_bitmap(struct LcdOperation* op) {
     } \
  \
     for(size_t y = 0; y < processHeight; ++y) { \
-        for(size_t x = 0; x < op->source.width; ++x) { \
+        for(size_t x = 0; x < op->source.width;) { \
             if(!mask) { \
                 if(lengthLeft > 0) { \
                     --lengthLeft; \
@@ -497,31 +884,23 @@ void tft_render_cont_bitmap(struct LcdOperation* op) {
                 mask = 0x80; \
             } \
  \
-            LcdColor color = (bits & mask) ? op->lo_fg : op->lo_bg; \
-            mask >>= 1; \
- \
-            if(op->source.scale == 1) { \
-                LCD_ENCODE_COLOR(x + y * op->source.width, color); \
-            } else {\
-                for(size_t i = 0; i < op->source.scale; ++i) { \
-                    for(size_t j = 0; j < op->source.scale; ++j) { \
-                        LCD_ENCODE_COLOR((x * op->source.scale + i) + (y * op->source.scale + j) * (op->source.width * op->source.scale), color); \
-                    } \
-                } \
-            } \
+            EXPAND_PIXELS(out, x, op->source.width) \
         } \
+ \
+        tft_scale_row(out, op->source.width, scale); \
+        out += scaledWidth * scale; \
     } \
  \
-    tft_set_window(op->lo_x, op->lo_y, op->lo_x + (op->source.width * op->source.scale) - 1, op->lo_y + (processHeight * op->source.scale) - 1); \
+    tft_set_window(op->lo_x, op->lo_y, op->lo_x + scaledWidth - 1, op->lo_y + (processHeight * scale) - 1); \
     tft_dma_memmode(1); \
-    tft_lcd_dma(tft_lcdBuffer, op->source.width * processHeight * op->source.scale * op->source.scale); \
+    tft_lcd_dma(tft_lcdBuffer, scaledWidth * processHeight * scale); \
  \
     if(doContinue) { \
-        struct LcdOperation* contOp = tft_new_operation(RLE_BITMAP_CONTINUE); \
+        struct LcdOperation* contOp = tft_new_continuation(RLE_BITMAP_CONTINUE); \
         contOp->lo_fg = op->lo_fg; \
         contOp->lo_bg = op->lo_bg; \
         contOp->lo_x = op->lo_x; \
-        contOp->lo_y = op->lo_y + processHeight; \
+        contOp->lo_y = op->lo_y + processHeight * scale; \
         contOp->lo_bitmap_cont.width = op->source.width; \
         contOp->lo_bitmap_cont.height = op->source.height - processHeight; \
         contOp->lo_bitmap_cont.bitmap = op->source.bitmap; \
@@ -530,7 +909,7 @@ void tft_render_cont_bitmap(struct LcdOperation* op) {
         contOp->lo_bitmap_cont.bitmapOffset = bitmapPos; \
         contOp->lo_bitmap_cont.lengthLeft = lengthLeft; \
         contOp->lo_bitmap_cont.scale = op->source.scale; \
-        tft_insert_after(op, contOp); \
+        tft_insert_next(contOp); \
     }
 
 void tft_render_bitmap_rle(struct LcdOperation* op) {
@@ -550,125 +929,1684 @@ void tft_render_cont_bitmap_rle(struct LcdOperation* op) {
     DO_RLE_BITMAP_RENDERING(lo_bitmap_cont)
 }
 
-void tft_render_op(struct LcdOperation* op) {
-    switch(op->lo_op) {
-        case RECT_FILL: {
-            size_t modifiedPixels = op->lo_rect.width * op->lo_rect.height;
-            if(modifiedPixels > LCD_MAX_DMA_TRANSFER) {
-                size_t maxLines = (LCD_MAX_DMA_TRANSFER) / op->lo_rect.width;
-
-                modifiedPixels = maxLines * op->lo_rect.width;
-                tft_set_window(op->lo_x, op->lo_y, op->lo_x + op->lo_rect.width - 1, op->lo_y + maxLines - 1);
-
-                struct LcdOperation* fillContinue = tft_new_operation(RECT_FILL);
-                fillContinue->lo_x = op->lo_x;
-                fillContinue->lo_y = op->lo_y + maxLines;
-                fillContinue->lo_rect.width = op->lo_rect.width;
-                fillContinue->lo_rect.height = op->lo_rect.height - maxLines;
-                fillContinue->lo_fg = op->lo_fg;
+/**
+ * @brief Render color bitmap
+ * Color bitmaps are stored as LcdColor words, they are sent by DMA
+ * straight from where they are (usually flash) without any copying.
+ *
+ * @param op Operation
+ */
+void tft_render_color_bitmap(struct LcdOperation* op) {
+    size_t lines = op->lo_bitmap.height;
+    if(op->lo_bitmap.width * lines > LCD_FILL_CHUNK) {
+        lines = (LCD_FILL_CHUNK) / op->lo_bitmap.width;
+
+        struct LcdOperation* cont = tft_new_continuation(COLOR_BITMAP);
+        cont->lo_x = op->lo_x;
+        cont->lo_y = op->lo_y + lines;
+        cont->lo_bitmap.width = op->lo_bitmap.width;
+        cont->lo_bitmap.height = op->lo_bitmap.height - lines;
+        cont->lo_bitmap.bitmap = (const uint16_t*)op->lo_bitmap.bitmap + op->lo_bitmap.width * lines;
+        cont->lo_bitmap.scale = 1;
+
+        tft_insert_next(cont);
+    }
 
-                tft_insert_after(op, fillContinue);
-            } else {
-                tft_set_window(op->lo_x, op->lo_y, op->lo_x + op->lo_rect.width - 1, op->lo_y + op->lo_rect.height - 1);
-            }
+    tft_set_window(op->lo_x, op->lo_y, op->lo_x + op->lo_bitmap.width - 1, op->lo_y + lines - 1);
+    tft_dma_memmode(1);
+    tft_lcd_dma(op->lo_bitmap.bitmap, op->lo_bitmap.width * lines);
+}
 
-            tft_dma_memmode(0);
-            tft_lcd_dma(&op->lo_fg, modifiedPixels);
-        } break;
-        case TEXT:
-            tft_render_text(op);
-            break;
-        case BITMAP:
-            tft_render_bitmap(op);
-            break;
-        case BITMAP_CONTINUE:
-            tft_render_cont_bitmap(op);
-            break;
-        case RLE_BITMAP:
-            tft_render_bitmap_rle(op);
+/**
+ * @brief Decode palette image row
+ * Pixels are packed MSB first, 4 bpp images are decoded a pixel pair
+ * (one byte) at a time.
+ *
+ * @param out Output pixels
+ * @param row Packed row data
+ * @param width Number of pixels
+ * @param bpp Bits per pixel (1, 2, 4 or 8)
+ * @param palette Color table
+ */
+void tft_decode_palette_row(uint16_t* out, const uint8_t* row, size_t width, uint8_t bpp, const LcdColor* palette) {
+    size_t x = 0;
+    switch(bpp) {
+        case 8:
+            for(; x < width; ++x)
+                out[x] = palette[row[x]].word;
             break;
-        case RLE_BITMAP_CONTINUE:
-            tft_render_cont_bitmap_rle(op);
+        case 4:
+            for(; x + 1 < width; x += 2) {
+                uint8_t pair = *row++;
+                out[x] = palette[pair >> 4].word;
+                out[x + 1] = palette[pair & 0x0F].word;
+            }
+            if(x < width)
+                out[x] = palette[*row >> 4].word;
             break;
+        default: {
+            uint8_t mask = (1 << bpp) - 1;
+            uint8_t shift = 0;
+            uint8_t bits = 0;
+            for(; x < width; ++x) {
+                if(!shift) {
+                    bits = *row++;
+                    shift = 8;
+                }
+                shift -= bpp;
+                out[x] = palette[(bits >> shift) & mask].word;
+            }
+        } break;
     }
 }
 
-/********** End of rendering functions **********/
+/**
+ * @brief Render palette bitmap
+ * Every row of the image starts on a byte boundary, so continuing
+ * the image only needs a pointer to the next row.
+ *
+ * @param op Operation
+ */
+void tft_render_palette_bitmap(struct LcdOperation* op) {
+    const uint8_t scale = op->lo_bitmap.scale;
+    const size_t width = op->lo_bitmap.width;
+    const size_t scaledWidth = width * scale;
+    const size_t stride = (width * op->lo_bitmap.bpp + 7) / 8;
+
+    size_t maxHeight = LCD_BUFFER_SIZE / (scaledWidth * scale);
+    size_t processHeight = op->lo_bitmap.height;
+
+    if(processHeight > maxHeight) {
+        processHeight = maxHeight;
+
+        struct LcdOperation* cont = tft_new_continuation(PALETTE_BITMAP);
+        memcpy(&cont->lo_bitmap, &op->lo_bitmap, sizeof(op->lo_bitmap));
+        cont->lo_x = op->lo_x;
+        cont->lo_y = op->lo_y + processHeight * scale;
+        cont->lo_bitmap.height = op->lo_bitmap.height - processHeight;
+        cont->lo_bitmap.bitmap = (const uint8_t*)op->lo_bitmap.bitmap + processHeight * stride;
+
+        tft_insert_next(cont);
+    }
 
-__attribute__((weak)) void tft_render_finished() { }
+    const uint8_t* row = op->lo_bitmap.bitmap;
+    uint16_t* out = tft_lcdBuffer;
+    for(size_t y = 0; y < processHeight; ++y, row += stride) {
+        tft_decode_palette_row(out, row, width, op->lo_bitmap.bpp, op->lo_bitmap.palette);
 
-void tft_lcd_dma_complete() {
-    // Take the current operation out of queue
-    struct LcdOperation* oldOp = tft_lcdOperations;
-    tft_lcdOperations = tft_lcdOperations->lo_next;
-    // Don't free static operations
-    if(!oldOp->lo_static)
-        free(oldOp);
+        tft_scale_row(out, width, scale);
+        out += scaledWidth * scale;
+    }
 
-    // Wait for SPI to finish doing it's thing
-    SPI_WAIT_NBSY();
+    tft_set_window(op->lo_x, op->lo_y, op->lo_x + scaledWidth - 1, op->lo_y + processHeight * scale - 1);
+    tft_dma_memmode(1);
+    tft_lcd_dma(tft_lcdBuffer, scaledWidth * processHeight * scale);
+}
+
+// Pixel run format
+// Rules:
+// Lengths of pixel runs in row order, starting with a background
+// run and alternating between the background and foreground color.
+// 0b0nnnnnnn - Run of n pixels
+// 0b1nnnnnnn 0xmm - Run of (n << 8 | mm) pixels
+// Runs of zero pixels can be used to split longer runs.
+
+size_t tft_read_run(const uint8_t* data, size_t* offset) {
+    uint8_t byte = data[(*offset)++];
+    if(byte & 0x80)
+        return ((byte & 0x7F) << 8) | data[(*offset)++];
+    return byte;
+}
 
-    if(tft_lcdOperations) {
-        // Render next operation
-        tft_render_op(tft_lcdOperations);
+/**
+ * @brief Render pixel runs
+ * Every call starts at the beginning of a row and sends either a band
+ * of rows covered by a single run as a DMA fill (nothing is rasterized),
+ * or rasterizes rows until the next such band starts.
+ *
+ * @param op Operation
+ * @param offset Offset of the next run in the data
+ * @param color Color of the current run (1 for foreground)
+ * @param left Pixels left in the current run
+ */
+void tft_render_runs(struct LcdOperation* op, size_t offset, uint8_t color, size_t left) {
+    const uint8_t* data = op->lo_bitmap_cont.bitmap;
+    const size_t width = op->lo_bitmap_cont.width;
+    const size_t height = op->lo_bitmap_cont.height;
+    const uint8_t scale = op->lo_bitmap_cont.scale;
+    const size_t scaledWidth = width * scale;
+
+    while(!left) {
+        left = tft_read_run(data, &offset);
+        color ^= 1;
+    }
+
+    size_t rows = 0;
+    if(left >= width) {
+        // Whole rows of a single color
+        size_t maxRows = (LCD_FILL_CHUNK) / (scaledWidth * scale);
+        rows = left / width;
+        if(rows > height)
+            rows = height;
+        if(rows > maxRows && maxRows)
+            rows = maxRows;
+        left -= rows * width;
+
+        tft_set_window(op->lo_x, op->lo_y, op->lo_x + scaledWidth - 1, op->lo_y + rows * scale - 1);
+        tft_dma_memmode(0);
+        tft_lcd_dma(color ? &op->lo_fg : &op->lo_bg, scaledWidth * rows * scale);
     } else {
-        // Finish the transfer
-        LCD_DESELECT();
-        tft_rendering = 0;
+        // Mixed rows, stop when a row of a single color comes up
+        size_t maxRows = LCD_BUFFER_SIZE / (scaledWidth * scale);
+        uint16_t* out = tft_lcdBuffer;
+
+        while(rows < height && rows < maxRows && (rows == 0 || left < width)) {
+            for(size_t x = 0; x < width;) {
+                while(!left) {
+                    left = tft_read_run(data, &offset);
+                    color ^= 1;
+                }
 
-        tft_render_finished();
+                size_t count = width - x;
+                if(left < count)
+                    count = left;
+                left -= count;
+
+                uint16_t word = color ? op->lo_fg.word : op->lo_bg.word;
+                for(size_t end = x + count; x < end; ++x)
+                    out[x] = word;
+            }
+
+            tft_scale_row(out, width, scale);
+            out += scaledWidth * scale;
+            ++rows;
+
+            // Look at the next run, it decides if the next row is solid
+            while(!left && rows < height) {
+                left = tft_read_run(data, &offset);
+                color ^= 1;
+            }
+        }
+
+        tft_set_window(op->lo_x, op->lo_y, op->lo_x + scaledWidth - 1, op->lo_y + rows * scale - 1);
+        tft_dma_memmode(1);
+        tft_lcd_dma(tft_lcdBuffer, scaledWidth * rows * scale);
+    }
+
+    if(rows < height) {
+        struct LcdOperation* cont = tft_new_continuation(RUN_BITMAP_CONTINUE);
+        cont->lo_fg = op->lo_fg;
+        cont->lo_bg = op->lo_bg;
+        cont->lo_x = op->lo_x;
+        cont->lo_y = op->lo_y + rows * scale;
+        cont->lo_bitmap_cont.width = width;
+        cont->lo_bitmap_cont.height = height - rows;
+        cont->lo_bitmap_cont.bitmap = data;
+        cont->lo_bitmap_cont.scale = scale;
+        cont->lo_bitmap_cont.bitmapOffset = offset;
+        cont->lo_bitmap_cont.bits = color;
+        cont->lo_bitmap_cont.lengthLeft = left;
+        tft_insert_next(cont);
     }
 }
 
-void tft_start_render() {
-    if(!tft_rendering && tft_lcdOperations) {
-        tft_rendering = 1;
-        tft_render_op(tft_lcdOperations);
+/**
+ * @brief Get gradient color
+ *
+ * @param op Gradient operation
+ * @param position Position along the gradient
+ * @param length Gradient length
+ * @return LcdColor Color at the position
+ */
+LcdColor tft_gradient_color(const struct LcdOperation* op, size_t position, size_t length) {
+    if(length < 2)
+        return op->lo_fg;
+    return tft_color_lerp(op->lo_fg, op->lo_bg, (position * 255 + (length - 1) / 2) / (length - 1));
+}
+
+/**
+ * @brief Render vertical gradient
+ * Every band of rows which quantize to the same color is a single fill,
+ * bands after the first one keep writing into the same window with the
+ * write continue command (unless something else moved the window).
+ *
+ * @param op Operation
+ */
+void tft_render_vgradient(struct LcdOperation* op) {
+    const size_t width = op->lo_gradient.width;
+    const size_t height = op->lo_gradient.height;
+    // Length of 0 means the whole gradient is in this operation
+    const size_t length = op->lo_gradient.length ? op->lo_gradient.length : height;
+    const size_t offset = op->lo_gradient.offset;
+    const uint16_t x1 = op->lo_x + width - 1;
+    const uint16_t y1 = op->lo_y + height - 1;
+
+    if(!width || !height) {
+        tft_lcd_dma_complete();
+        return;
+    }
+
+    tft_fillColor = tft_gradient_color(op, offset, length);
+
+    size_t maxRows = (LCD_FILL_CHUNK) / width;
+    size_t rows = 1;
+    while(rows < height && rows < maxRows && tft_gradient_color(op, offset + rows, length).word == tft_fillColor.word)
+        ++rows;
+
+    if(tft_windowCursorY == op->lo_y && tft_windowX0 == op->lo_x && tft_windowX1 == x1 && tft_windowY1 == y1)
+        tft_lcd_cmd(0x3C);
+    else
+        tft_set_window(op->lo_x, op->lo_y, x1, y1);
+    tft_windowCursorY = op->lo_y + rows;
+
+    if(rows < height) {
+        struct LcdOperation* cont = tft_new_continuation(VGRADIENT_FILL);
+        cont->lo_fg = op->lo_fg;
+        cont->lo_bg = op->lo_bg;
+        cont->lo_x = op->lo_x;
+        cont->lo_y = op->lo_y + rows;
+        cont->lo_gradient.width = width;
+        cont->lo_gradient.height = height - rows;
+        cont->lo_gradient.length = length;
+        cont->lo_gradient.offset = offset + rows;
+        tft_insert_next(cont);
     }
+
+    tft_dma_memmode(0);
+    tft_lcd_dma(&tft_fillColor, width * rows);
 }
 
-void tft_driver_init() {
-    /************ Configure on-chip peripherals **************/
+/**
+ * @brief Render horizontal gradient
+ * The row is rasterized once and copied down the buffer.
+ *
+ * @param op Operation
+ */
+void tft_render_hgradient(struct LcdOperation* op) {
+    const size_t width = op->lo_gradient.width;
+    size_t rows = op->lo_gradient.height;
+    if(!width || !rows) {
+        tft_lcd_dma_complete();
+        return;
+    }
 
-    // Enable clocks
-    __HAL_RCC_GPIOA_CLK_ENABLE();
-    __HAL_RCC_GPIOB_CLK_ENABLE();
-    __HAL_RCC_SPI1_CLK_ENABLE();
-    __HAL_RCC_DMA2_CLK_ENABLE();
+    const size_t maxRows = LCD_BUFFER_SIZE / width;
 
-    // Initialize the GPIO
-    GPIO_InitTypeDef GpioOut;
-    GpioOut.Pin = LCD_SS;
-    GpioOut.Mode = GPIO_MODE_OUTPUT_PP;
-    GpioOut.Pull = GPIO_NOPULL;
-    GpioOut.Speed = GPIO_SPEED_HIGH;
-    HAL_GPIO_Init(GPIOA, &GpioOut);
+    if(rows > maxRows) {
+        rows = maxRows;
 
-    GpioOut.Pin = LCD_DC | LCD_RST | TP_SS;
-    HAL_GPIO_Init(GPIOB, &GpioOut);
+        struct LcdOperation* cont = tft_new_continuation(HGRADIENT_FILL);
+        cont->lo_fg = op->lo_fg;
+        cont->lo_bg = op->lo_bg;
+        cont->lo_x = op->lo_x;
+        cont->lo_y = op->lo_y + rows;
+        cont->lo_gradient.width = width;
+        cont->lo_gradient.height = op->lo_gradient.height - rows;
+        tft_insert_next(cont);
+    }
 
-    GPIO_InitTypeDef GpioAf;
-    GpioAf.Pin = LCD_MOSI | LCD_MISO;
-    GpioAf.Mode = GPIO_MODE_AF_PP;
-    GpioAf.Pull = GPIO_NOPULL;
-    GpioAf.Speed = GPIO_SPEED_HIGH;
-    GpioAf.Alternate = 5;
-    HAL_GPIO_Init(GPIOA, &GpioAf);
+    for(size_t x = 0; x < width; ++x)
+        tft_lcdBuffer[x] = tft_gradient_color(op, x, width).word;
+    for(size_t y = 1; y < rows; ++y)
+        memcpy(tft_lcdBuffer + y * width, tft_lcdBuffer, width * sizeof(uint16_t));
 
-    GpioAf.Pin = LCD_SCK;
-    GpioAf.Pull = GPIO_PULLDOWN;
-    HAL_GPIO_Init(GPIOA, &GpioAf);
+    tft_set_window(op->lo_x, op->lo_y, op->lo_x + width - 1, op->lo_y + rows - 1);
+    tft_dma_memmode(1);
+    tft_lcd_dma(tft_lcdBuffer, width * rows);
+}
 
-    TP_DESELECT();
-    LCD_DESELECT();
-    LCD_DEASSERT_RST();
-    LCD_DELAY(5);
+/********** Shapes **********/
+
+// A ring cut by an arc over half a circle has the most spans in a row
+#define SHAPE_MAX_SPANS 4
+// Setting up a window costs roughly as much as sending this many pixels,
+// mixed rows wide enough to pay for a window per run are sent as fills
+#define SHAPE_RUN_COST 32
+
+#define ROW_BACKGROUND 0
+#define ROW_FOREGROUND 1
+#define ROW_MIXED 2
+
+typedef struct ShapeSpan_t {
+    int16_t ss_start;
+    // Exclusive
+    int16_t ss_end;
+} ShapeSpan;
+
+// Sine of 0 - 90 degrees, 16384 is 1.0
+const uint16_t tft_sinTable[91] = {
+    0, 286, 572, 857, 1143, 1428, 1713, 1997, 2280, 2563,
+    2845, 3126, 3406, 3686, 3964, 4240, 4516, 4790, 5063, 5334,
+    5604, 5872, 6138, 6402, 6664, 6924, 7182, 7438, 7692, 7943,
+    8192, 8438, 8682, 8923, 9162, 9397, 9630, 9860, 10087, 10311,
+    10531, 10749, 10963, 11174, 11381, 11585, 11786, 11982, 12176, 12365,
+    12551, 12733, 12911, 13085, 13255, 13421, 13583, 13741, 13894, 14044,
+    14189, 14330, 14466, 14598, 14726, 14849, 14968, 15082, 15191, 15296,
+    15396, 15491, 15582, 15668, 15749, 15826, 15897, 15964, 16026, 16083,
+    16135, 16182, 16225, 16262, 16294, 16322, 16344, 16362, 16374, 16382,
+    16384
+};
 
-    // Initialize the SPI interface
-    __HAL_RCC_SPI1_FORCE_RESET();
-    __HAL_RCC_SPI1_RELEASE_RESET();
+int32_t tft_sin(int32_t angle) {
+    angle %= 360;
+    if(angle < 0)
+        angle += 360;
+
+    if(angle <= 90)
+        return tft_sinTable[angle];
+    if(angle <= 180)
+        return tft_sinTable[180 - angle];
+    if(angle <= 270)
+        return -(int32_t)tft_sinTable[angle - 180];
+    return -(int32_t)tft_sinTable[360 - angle];
+}
 
-    // Initialize the SPI interface
+uint32_t tft_isqrt(uint32_t value) {
+    uint32_t result = 0;
+    uint32_t bit = 1UL << 30;
+
+    while(bit > value)
+        bit >>= 2;
+
+    while(bit) {
+        if(value >= result + bit) {
+            value -= result + bit;
+            result = (result >> 1) + bit;
+        } else {
+            result >>= 1;
+        }
+        bit >>= 2;
+    }
+    return result;
+}
+
+/**
+ * @brief Get circle row half width
+ * Matches the rows of a midpoint circle, r^2 + r is (r + 0.5)^2 rounded.
+ *
+ * @param radius Radius
+ * @param dy Row distance from the center
+ * @return int32_t Half width (without the center pixel), -1 if the row misses the circle
+ */
+int32_t tft_circle_half(int32_t radius, int32_t dy) {
+    if(dy < 0)
+        dy = -dy;
+    if(dy > radius)
+        return -1;
+    return tft_isqrt(radius * radius + radius - dy * dy);
+}
+
+/**
+ * @brief Add span
+ * Clips the span to the row, touching spans are merged.
+ */
+void tft_add_span(ShapeSpan* spans, size_t* count, int32_t start, int32_t end, int32_t width) {
+    if(start < 0)
+        start = 0;
+    if(end > width)
+        end = width;
+    if(start >= end)
+        return;
+
+    if(*count && spans[*count - 1].ss_end >= start) {
+        if(end > spans[*count - 1].ss_end)
+            spans[*count - 1].ss_end = end;
+        return;
+    }
+
+    if(*count < SHAPE_MAX_SPANS) {
+        spans[*count].ss_start = start;
+        spans[*count].ss_end = end;
+        ++*count;
+    }
+}
+
+/**
+ * @brief Get line row span
+ * Stateless form of Bresenham's algorithm, a row covers every step
+ * which rounds to it, so continuations can start at any row.
+ */
+void tft_line_spans(const struct LcdOperation* op, int32_t y, int32_t width, ShapeSpan* spans, size_t* count) {
+    int32_t x0 = op->lo_shape.x0, y0 = op->lo_shape.y0;
+    int32_t x1 = op->lo_shape.x1, y1 = op->lo_shape.y1;
+
+    if(y0 > y1) {
+        int32_t tmp = x0; x0 = x1; x1 = tmp;
+        tmp = y0; y0 = y1; y1 = tmp;
+    }
+    if(y < y0 || y > y1)
+        return;
+
+    const int32_t dx = x1 - x0;
+    const int32_t dy = y1 - y0;
+    const int32_t adx = dx < 0 ? -dx : dx;
+    const int32_t k = y - y0;
+    int32_t t0, t1;
+
+    if(dy == 0) {
+        t0 = 0;
+        t1 = adx;
+    } else if(adx > dy) {
+        // Steps from the middle between the previous row and this one to the next middle
+        t0 = k ? ((2 * k - 1) * adx + 2 * dy - 1) / (2 * dy) : 0;
+        t1 = k < dy ? ((2 * k + 1) * adx + 2 * dy - 1) / (2 * dy) - 1 : adx;
+    } else {
+        t0 = t1 = (2 * k * adx + dy) / (2 * dy);
+    }
+
+    if(dx < 0)
+        tft_add_span(spans, count, x0 - t1, x0 - t0 + 1, width);
+    else
+        tft_add_span(spans, count, x0 + t0, x0 + t1 + 1, width);
+}
+
+/**
+ * @brief Get ring row spans
+ * Filled circle if the thickness is 0 (or covers the whole radius).
+ */
+void tft_ring_spans(int32_t cx, int32_t dy, int32_t radius, int32_t thickness, int32_t width, ShapeSpan* spans, size_t* count) {
+    int32_t outer = tft_circle_half(radius, dy);
+    if(outer < 0)
+        return;
+
+    int32_t inner = thickness && thickness < radius ? tft_circle_half(radius - thickness, dy) : -1;
+    if(inner < 0) {
+        tft_add_span(spans, count, cx - outer, cx + outer + 1, width);
+    } else {
+        tft_add_span(spans, count, cx - outer, cx - inner, width);
+        tft_add_span(spans, count, cx + inner + 1, cx + outer + 1, width);
+    }
+}
+
+/**
+ * @brief Get rounded rectangle row span
+ *
+ * @return uint8_t 0 if the row is outside of the rectangle
+ */
+uint8_t tft_round_rect_span(int32_t y, int32_t w, int32_t h, int32_t radius, int32_t* start, int32_t* end) {
+    if(y < 0 || y >= h || w <= 0)
+        return 0;
+
+    if(radius > w / 2)
+        radius = w / 2;
+    if(radius > h / 2)
+        radius = h / 2;
+
+    int32_t inset = 0;
+    if(y < radius)
+        inset = radius - tft_circle_half(radius, radius - y);
+    else if(y >= h - radius)
+        inset = radius - tft_circle_half(radius, y - (h - 1 - radius));
+
+    *start = inset;
+    *end = w - inset;
+    return 1;
+}
+
+/**
+ * @brief Get shape row spans
+ *
+ * @param op Shape operation
+ * @param y Row relative to the box
+ * @param width Clipped box width
+ * @param spans Output spans, sorted and clipped to the width
+ * @return size_t Number of spans
+ */
+size_t tft_shape_spans(const struct LcdOperation* op, int32_t y, int32_t width, ShapeSpan* spans) {
+    const int32_t thickness = op->lo_shape.thickness;
+    size_t count = 0;
+
+    switch(op->lo_op) {
+        case LINE:
+            tft_line_spans(op, y, width, spans, &count);
+            break;
+        case CIRCLE:
+            tft_ring_spans(op->lo_shape.x0, y - op->lo_shape.y0, op->lo_shape.radius, thickness, width, spans, &count);
+            break;
+        case ARC: {
+            ShapeSpan ring[SHAPE_MAX_SPANS];
+            size_t ringCount = 0;
+            const int32_t dy = y - op->lo_shape.y0;
+            tft_ring_spans(op->lo_shape.x0, dy, op->lo_shape.radius, thickness, width, ring, &ringCount);
+
+            int32_t sweep = (op->lo_shape.y1 - op->lo_shape.x1) % 360;
+            if(sweep < 0)
+                sweep += 360;
+            if(!sweep) {
+                memcpy(spans, ring, sizeof(ShapeSpan) * ringCount);
+                return ringCount;
+            }
+
+            const int32_t sx = tft_sin(op->lo_shape.x1 + 90), sy = tft_sin(op->lo_shape.x1);
+            const int32_t ex = tft_sin(op->lo_shape.y1 + 90), ey = tft_sin(op->lo_shape.y1);
+
+            // Keep the pixels between the start and end directions
+            for(size_t i = 0; i < ringCount; ++i) {
+                int32_t runStart = -1;
+                for(int32_t x = ring[i].ss_start; x <= ring[i].ss_end; ++x) {
+                    uint8_t inside = 0;
+                    if(x < ring[i].ss_end) {
+                        const int32_t px = x - op->lo_shape.x0;
+                        const int32_t afterStart = sx * dy - sy * px;
+                        const int32_t beforeEnd = px * ey - dy * ex;
+                        if(sweep <= 180)
+                            inside = afterStart >= 0 && beforeEnd >= 0;
+                        else
+                            inside = afterStart >= 0 || beforeEnd >= 0;
+                    }
+
+                    if(inside && runStart < 0) {
+                        runStart = x;
+                    } else if(!inside && runStart >= 0) {
+                        tft_add_span(spans, &count, runStart, x, width);
+                        runStart = -1;
+                    }
+                }
+            }
+        } break;
+        case ROUND_RECT: {
+            const int32_t w = op->lo_shape.width;
+            const int32_t h = op->lo_shape.height;
+            const int32_t radius = op->lo_shape.radius;
+            int32_t start, end, innerStart, innerEnd;
+
+            if(!tft_round_rect_span(y, w, h, radius, &start, &end))
+                break;
+
+            if(thickness && tft_round_rect_span(y - thickness, w - thickness * 2, h - thickness * 2,
+                                                radius > thickness ? radius - thickness : 0, &innerStart, &innerEnd)) {
+                tft_add_span(spans, &count, start, innerStart + thickness, width);
+                tft_add_span(spans, &count, innerEnd + thickness, end, width);
+            } else {
+                tft_add_span(spans, &count, start, end, width);
+            }
+        } break;
+        default:
+            break;
+    }
+    return count;
+}
+
+uint8_t tft_row_kind(const ShapeSpan* spans, size_t count, size_t width) {
+    if(!count)
+        return ROW_BACKGROUND;
+    if(count == 1 && spans[0].ss_start == 0 && spans[0].ss_end == (int32_t)width)
+        return ROW_FOREGROUND;
+    return ROW_MIXED;
+}
+
+/**
+ * @brief Get row run
+ * Even runs are the background in front of span run / 2,
+ * odd runs are the spans.
+ *
+ * @return uint8_t 0 if the row doesn't have that many runs
+ */
+uint8_t tft_shape_run(const ShapeSpan* spans, size_t count, size_t width, size_t run, size_t* start, size_t* end) {
+    if(run > count * 2)
+        return 0;
+
+    size_t i = run / 2;
+    if(run & 1) {
+        *start = spans[i].ss_start;
+        *end = spans[i].ss_end;
+    } else {
+        *start = i ? spans[i - 1].ss_end : 0;
+        *end = i < count ? (size_t)spans[i].ss_start : width;
+    }
+    return 1;
+}
+
+/**
+ * @brief Render shape
+ * Rows of a single color are sent as one fill, wide mixed rows are sent
+ * as a fill per run and the rest (thin outlines, lines) is rasterized in
+ * the line buffer. The shape continues itself with the next row or run.
+ *
+ * @param op Operation
+ */
+void tft_render_shape(struct LcdOperation* op) {
+    size_t width = op->lo_shape.width;
+    size_t height = op->lo_shape.height;
+    const size_t row = op->lo_shape.row;
+    ShapeSpan spans[SHAPE_MAX_SPANS];
+
+    // Clip the box to the screen
+    if(op->lo_x >= TFT_WIDTH || op->lo_y >= TFT_HEIGHT) {
+        tft_lcd_dma_complete();
+        return;
+    }
+    if(op->lo_x + width > TFT_WIDTH)
+        width = TFT_WIDTH - op->lo_x;
+    if(op->lo_y + height > TFT_HEIGHT)
+        height = TFT_HEIGHT - op->lo_y;
+    if(!width || row >= height) {
+        tft_lcd_dma_complete();
+        return;
+    }
+
+    const uint16_t x = op->lo_x;
+    const uint16_t y = op->lo_y + row;
+    size_t count = tft_shape_spans(op, row, width, spans);
+    const uint8_t kind = tft_row_kind(spans, count, width);
+    size_t rows = 0;
+    size_t nextRun = 0;
+
+    if(kind != ROW_MIXED) {
+        size_t maxRows = (LCD_FILL_CHUNK) / width;
+        rows = 1;
+        while(row + rows < height && rows < maxRows) {
+            count = tft_shape_spans(op, row + rows, width, spans);
+            if(tft_row_kind(spans, count, width) != kind)
+                break;
+            ++rows;
+        }
+
+        tft_fillColor = kind == ROW_FOREGROUND ? op->lo_fg : op->lo_bg;
+        tft_set_window(x, y, x + width - 1, y + rows - 1);
+        tft_dma_memmode(0);
+        tft_lcd_dma(&tft_fillColor, width * rows);
+    } else if(width >= (count * 2 + 1) * SHAPE_RUN_COST) {
+        size_t run = op->lo_shape.run;
+        size_t start = 0, end = 0, nextStart, nextEnd;
+
+        // Spans can touch the edges, those background runs are empty
+        while(tft_shape_run(spans, count, width, run, &start, &end) && start == end)
+            ++run;
+        nextRun = run + 1;
+        while(tft_shape_run(spans, count, width, nextRun, &nextStart, &nextEnd) && nextStart == nextEnd)
+            ++nextRun;
+
+        if(nextRun > count * 2) {
+            // Last run of the row
+            nextRun = 0;
+            rows = 1;
+        }
+
+        tft_fillColor = (run & 1) ? op->lo_fg : op->lo_bg;
+        tft_set_window(x + start, y, x + end - 1, y);
+        tft_dma_memmode(0);
+        tft_lcd_dma(&tft_fillColor, end - start);
+    } else {
+        // Rasterize until a row which is cheaper to send another way
+        const size_t maxRows = LCD_BUFFER_SIZE / width;
+        uint16_t* out = tft_lcdBuffer;
+
+        while(1) {
+            for(size_t i = 0; i < width; ++i)
+                out[i] = op->lo_bg.word;
+            for(size_t i = 0; i < count; ++i) {
+                for(int32_t j = spans[i].ss_start; j < spans[i].ss_end; ++j)
+                    out[j] = op->lo_fg.word;
+            }
+
+            out += width;
+            ++rows;
+            if(row + rows >= height || rows >= maxRows)
+                break;
+
+            count = tft_shape_spans(op, row + rows, width, spans);
+            if(tft_row_kind(spans, count, width) != ROW_MIXED || width >= (count * 2 + 1) * SHAPE_RUN_COST)
+                break;
+        }
+
+        tft_set_window(x, y, x + width - 1, y + rows - 1);
+        tft_dma_memmode(1);
+        tft_lcd_dma(tft_lcdBuffer, width * rows);
+    }
+
+    if(row + rows < height || nextRun) {
+        struct LcdOperation* cont = tft_new_continuation(op->lo_op);
+        cont->lo_fg = op->lo_fg;
+        cont->lo_bg = op->lo_bg;
+        cont->lo_x = op->lo_x;
+        cont->lo_y = op->lo_y;
+        cont->lo_shape = op->lo_shape;
+        cont->lo_shape.row = row + rows;
+        cont->lo_shape.run = nextRun;
+        tft_insert_next(cont);
+    }
+}
+
+/**
+ * @brief Set vertical scrolling
+ * Rows above and below the scroll area stay in place.
+ *
+ * @param top First row of the scroll area
+ * @param height Height of the scroll area
+ * @param start Row shown at the top of the scroll area
+ */
+void tft_set_scroll(uint16_t top, uint16_t height, uint16_t start) {
+    const uint16_t bottom = TFT_HEIGHT - top - height;
+
+    uint16_t data[6] = { top >> 8, top & 0xFF, height >> 8, height & 0xFF, bottom >> 8, bottom & 0xFF };
+    tft_lcd_cmd_data(0x33, data, sizeof(data));
+    data[0] = start >> 8;
+    data[1] = start & 0xFF;
+    tft_lcd_cmd_data(0x37, data, 2 * sizeof(uint16_t));
+}
+
+/********** Plots **********/
+
+// Maps a sample onto the value axis, 0 at lp_min and span at lp_max
+int32_t tft_plot_level(const LcdPlot* plot, int16_t value, int32_t span) {
+    const int32_t range = plot->lp_max - plot->lp_min;
+    int32_t level = range ? ((int32_t)value - plot->lp_min) * span / range : 0;
+    if(level < 0)
+        level = 0;
+    if(level > span)
+        level = span;
+    return level;
+}
+
+// The head is the gap between the newest and the oldest sample
+uint8_t tft_plot_valid(const LcdPlot* plot, int32_t index) {
+    if(index < 0 || index >= plot->lp_capacity || index == plot->lp_head)
+        return 0;
+    return plot->lp_count >= plot->lp_capacity || index < plot->lp_head;
+}
+
+/**
+ * @brief Get trace segment
+ * The trace of a sample connects its level with the level of the previous
+ * sample, sweep plots don't connect the end of the ring with its start.
+ *
+ * @param plot Plot
+ * @param index Sample index
+ * @param span Level of lp_max
+ * @param low Output lowest level
+ * @param high Output highest level
+ * @return uint8_t 1 if the sample has a trace
+ */
+uint8_t tft_plot_segment(const LcdPlot* plot, int32_t index, int32_t span, int32_t* low, int32_t* high) {
+    if(!tft_plot_valid(plot, index))
+        return 0;
+
+    *low = *high = tft_plot_level(plot, plot->lp_samples[index], span);
+
+    int32_t prev = index - 1;
+    if(!index && (plot->lp_flags & PLOT_SCROLL))
+        prev = plot->lp_capacity - 1;
+    if(tft_plot_valid(plot, prev)) {
+        const int32_t level = tft_plot_level(plot, plot->lp_samples[prev], span);
+        if(level < *low)
+            *low = level;
+        if(level > *high)
+            *high = level;
+    }
+    return 1;
+}
+
+/**
+ * @brief Rasterize plot area
+ * Draws the axes, grid and trace of a part of the plot box.
+ *
+ * @param plot Plot
+ * @param fg Trace color
+ * @param bg Background color
+ * @param out Pixel of (x0, y0)
+ * @param stride Output row length
+ * @param x0 Left edge, relative to the box
+ * @param y0 Top edge, relative to the box
+ * @param x1 Right edge (exclusive)
+ * @param y1 Bottom edge (exclusive)
+ */
+void tft_plot_area(const LcdPlot* plot, LcdColor fg, LcdColor bg, uint16_t* out, size_t stride, int32_t x0, int32_t y0, int32_t x1, int32_t y1) {
+    const uint8_t scroll = plot->lp_flags & PLOT_SCROLL;
+    const int32_t height = plot->lp_height;
+    const int32_t step = plot->lp_gridStep;
+
+    for(int32_t y = y0; y < y1; ++y) {
+        uint16_t* row = out + (y - y0) * stride - x0;
+
+        // Sweep plots have the time axis in the last row, grid rows count up from it
+        uint8_t axisRow = !scroll && y == height - 1;
+        uint8_t gridRow = step && (scroll ? y % step == 0 : (height - 2 - y) % step == 0);
+
+        for(int32_t x = x0; x < x1; ++x) {
+            if(!x || axisRow)
+                row[x] = plot->lp_axisColor.word;
+            else if(gridRow || (step && (x - 1) % step == 0))
+                row[x] = plot->lp_gridColor.word;
+            else
+                row[x] = bg.word;
+        }
+    }
+
+    int32_t low, high;
+    if(scroll) {
+        // Sample per row, levels go to the right
+        const int32_t span = plot->lp_width - 2;
+        for(int32_t y = y0; y < y1; ++y) {
+            if(!tft_plot_segment(plot, y, span, &low, &high))
+                continue;
+
+            int32_t start = 1 + low < x0 ? x0 : 1 + low;
+            int32_t end = 2 + high > x1 ? x1 : 2 + high;
+            uint16_t* row = out + (y - y0) * stride - x0;
+            for(int32_t x = start; x < end; ++x)
+                row[x] = fg.word;
+        }
+    } else {
+        // Sample per column (after the axis), levels go up
+        const int32_t span = height - 2;
+        for(int32_t x = x0 < 1 ? 1 : x0; x < x1; ++x) {
+            if(!tft_plot_segment(plot, x - 1, span, &low, &high))
+                continue;
+
+            int32_t start = span - high < y0 ? y0 : span - high;
+            int32_t end = span - low + 1 > y1 ? y1 : span - low + 1;
+            for(int32_t y = start; y < end; ++y)
+                out[(y - y0) * stride + x - x0] = fg.word;
+        }
+    }
+}
+
+/**
+ * @brief Render plot
+ * Sweep plots are sent in bands of columns and scrolling plots in bands
+ * of rows, samples are read from the ring when the band is rasterized.
+ * The last band of a scrolling plot moves the scroll start so that the
+ * row after the gap is at the top.
+ *
+ * @param op Operation
+ */
+void tft_render_plot(struct LcdOperation* op) {
+    const LcdPlot* plot = op->lo_plot.plot;
+    const uint8_t scroll = plot->lp_flags & PLOT_SCROLL;
+    size_t width = op->lo_plot.width;
+    size_t height = op->lo_plot.height;
+
+    size_t left;
+    if(scroll) {
+        left = height;
+        if(height > LCD_BUFFER_SIZE / width)
+            height = LCD_BUFFER_SIZE / width;
+        left -= height;
+    } else {
+        left = width;
+        if(width > LCD_BUFFER_SIZE / height)
+            width = LCD_BUFFER_SIZE / height;
+        left -= width;
+    }
+
+    const int32_t x0 = scroll ? 0 : op->lo_plot.first;
+    const int32_t y0 = scroll ? op->lo_plot.first : 0;
+    tft_plot_area(plot, op->lo_fg, op->lo_bg, tft_lcdBuffer, width, x0, y0, x0 + width, y0 + height);
+
+    if(left) {
+        struct LcdOperation* cont = tft_new_continuation(PLOT);
+        cont->lo_fg = op->lo_fg;
+        cont->lo_bg = op->lo_bg;
+        cont->lo_x = scroll ? op->lo_x : op->lo_x + width;
+        cont->lo_y = scroll ? op->lo_y + height : op->lo_y;
+        cont->lo_plot.width = scroll ? width : left;
+        cont->lo_plot.height = scroll ? left : height;
+        cont->lo_plot.plot = plot;
+        cont->lo_plot.first = op->lo_plot.first + (scroll ? height : width);
+        cont->lo_plot.top = op->lo_plot.top;
+        tft_insert_next(cont);
+    } else if(scroll) {
+        // Scroll area covers the box
+        const uint16_t top = op->lo_y - op->lo_plot.first;
+        tft_set_scroll(top, plot->lp_height, top + op->lo_plot.top);
+    }
+
+    tft_set_window(op->lo_x, op->lo_y, op->lo_x + width - 1, op->lo_y + height - 1);
+    tft_dma_memmode(1);
+    tft_lcd_dma(tft_lcdBuffer, width * height);
+}
+
+/********** Compositing **********/
+
+uint8_t tft_operation_size(const struct LcdOperation* op, uint16_t* width, uint16_t* height) {
+    *width = 0;
+    *height = 0;
+
+    switch(op->lo_op) {
+        case RECT_FILL:
+            *width = op->lo_rect.width;
+            *height = op->lo_rect.height;
+            return 1;
+        case TEXT: {
+            // The background is drawn over the whole width of the longest line
+            const struct BitmapFont* font = op->lo_text.font;
+            size_t lines = 1;
+            size_t x = 0;
+            size_t xMax = 0;
+            for(const char* c = op->lo_text.value; *c; ++c) {
+                if(*c == '\n') {
+                    x = 0;
+                    ++lines;
+                } else if(*c >= font->bf_firstChar && *c <= font->bf_lastChar) {
+                    x += font->bf_glyphs[*c - font->bf_firstChar].bfg_xAdvance;
+                    if(x > xMax)
+                        xMax = x;
+                }
+            }
+            *width = xMax;
+            *height = lines * font->bf_yAdvance;
+            return 1;
+        }
+        case BITMAP:
+        case RLE_BITMAP:
+        case COLOR_BITMAP:
+        case PALETTE_BITMAP:
+        case RUN_BITMAP:
+            *width = op->lo_bitmap.width * op->lo_bitmap.scale;
+            *height = op->lo_bitmap.height * op->lo_bitmap.scale;
+            return 1;
+        case VGRADIENT_FILL:
+        case HGRADIENT_FILL:
+            *width = op->lo_gradient.width;
+            *height = op->lo_gradient.height;
+            return 1;
+        case LINE:
+        case CIRCLE:
+        case ARC:
+        case ROUND_RECT:
+            // Shapes paint their whole box, the rest of it with lo_bg
+            *width = op->lo_shape.width;
+            *height = op->lo_shape.height;
+            return 1;
+        case PLOT:
+            // Scrolling plots move whole panel rows, they can't be drawn anywhere else
+            if(op->lo_plot.plot->lp_flags & PLOT_SCROLL)
+                return 0;
+            *width = op->lo_plot.width;
+            *height = op->lo_plot.height;
+            return 1;
+        case COMPOSITE:
+            *width = op->lo_composite.width;
+            *height = op->lo_composite.height;
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// Screen area, the end coordinates are exclusive
+typedef struct CompositeArea_t {
+    int32_t ca_x0;
+    int32_t ca_y0;
+    int32_t ca_x1;
+    int32_t ca_y1;
+} CompositeArea;
+
+typedef struct CompositeBand_t {
+    uint16_t* cb_out;
+    CompositeArea cb_area;
+} CompositeBand;
+
+#define BAND_PIXEL(band, x, y) \
+    ((band)->cb_out + ((y) - (band)->cb_area.ca_y0) * ((band)->cb_area.ca_x1 - (band)->cb_area.ca_x0) + ((x) - (band)->cb_area.ca_x0))
+
+// Decodes the bytes of BITMAP and RLE_BITMAP masks in order
+typedef struct MaskReader_t {
+    const uint8_t* mr_data;
+    size_t mr_offset;
+    size_t mr_lengthLeft;
+    // Number of decoded bytes, mr_byte is the last one
+    size_t mr_index;
+    uint8_t mr_byte;
+    uint8_t mr_rle;
+} MaskReader;
+
+uint8_t tft_mask_byte(MaskReader* reader, size_t index) {
+    if(!reader->mr_rle)
+        return reader->mr_data[index];
+
+    // Same rules as the RLE bitmap renderer
+    while(reader->mr_index <= index) {
+        if(reader->mr_lengthLeft > 0) {
+            --reader->mr_lengthLeft;
+        } else {
+            uint8_t byte = reader->mr_data[reader->mr_offset++];
+            if(byte == 0xFF) {
+                reader->mr_lengthLeft = reader->mr_data[reader->mr_offset++];
+                reader->mr_byte = reader->mr_data[reader->mr_offset++];
+            } else {
+                reader->mr_byte = byte;
+            }
+        }
+        ++reader->mr_index;
+    }
+    return reader->mr_byte;
+}
+
+void tft_composite_fill(const CompositeBand* band, const CompositeArea* clip, uint16_t word) {
+    for(int32_t y = clip->ca_y0; y < clip->ca_y1; ++y) {
+        uint16_t* out = BAND_PIXEL(band, clip->ca_x0, y);
+        for(int32_t x = clip->ca_x0; x < clip->ca_x1; ++x)
+            *out++ = word;
+    }
+}
+
+/**
+ * @brief Composite text
+ * Only the glyphs are drawn when the text is keyed, so
+ * it can be placed over anything drawn before it.
+ */
+void tft_composite_text(const struct LcdOperation* op, const CompositeBand* band, const CompositeArea* clip, uint8_t keyed) {
+    const struct BitmapFont* font = op->lo_text.font;
+    const uint16_t fgWord = op->lo_fg.word;
+
+    if(!keyed)
+        tft_composite_fill(band, clip, op->lo_bg.word);
+
+    int32_t penX = op->lo_x;
+    int32_t lineY = op->lo_y + font->bf_yAdvance;
+    for(const char* c = op->lo_text.value; *c; ++c) {
+        if(*c == '\n') {
+            penX = op->lo_x;
+            lineY += font->bf_yAdvance;
+            continue;
+        }
+        if(*c < font->bf_firstChar || *c > font->bf_lastChar)
+            continue;
+
+        const struct BitmapFontGlyph glyph = font->bf_glyphs[*c - font->bf_firstChar];
+        const int32_t gx = penX + glyph.bfg_xOffset;
+        const int32_t gy = lineY + glyph.bfg_yOffset - FONT_Y_OFFSET;
+        penX += glyph.bfg_xAdvance;
+
+        // Part of the glyph inside of the clip area
+        int32_t rowStart = clip->ca_y0 - gy > 0 ? clip->ca_y0 - gy : 0;
+        int32_t rowEnd = clip->ca_y1 - gy < glyph.bfg_height ? clip->ca_y1 - gy : glyph.bfg_height;
+        int32_t colStart = clip->ca_x0 - gx > 0 ? clip->ca_x0 - gx : 0;
+        int32_t colEnd = clip->ca_x1 - gx < glyph.bfg_width ? clip->ca_x1 - gx : glyph.bfg_width;
+
+        for(int32_t row = rowStart; row < rowEnd; ++row) {
+            const uint8_t* bitmap = font->bf_bitmap + glyph.bfg_bitmapOffset;
+            size_t bit = row * glyph.bfg_width + colStart;
+            uint16_t* out = BAND_PIXEL(band, gx + colStart, gy + row);
+
+            for(int32_t col = colStart; col < colEnd; ++col, ++bit, ++out) {
+                if(bitmap[bit >> 3] & (0x80 >> (bit & 7)))
+                    *out = fgWord;
+            }
+        }
+    }
+}
+
+void tft_composite_mask(const struct LcdOperation* op, const CompositeBand* band, const CompositeArea* clip) {
+    const size_t width = op->lo_bitmap.width;
+    const uint8_t scale = op->lo_bitmap.scale;
+    MaskReader reader = { op->lo_bitmap.bitmap, 0, 0, 0, 0, op->lo_op == RLE_BITMAP };
+    // Scaled rows are read more than once, the reader goes back to the row start
+    MaskReader rowReader = reader;
+    size_t prevRow = SIZE_MAX;
+
+    for(int32_t y = clip->ca_y0; y < clip->ca_y1; ++y) {
+        const size_t sourceRow = (y - op->lo_y) / scale;
+        const size_t rowBit = sourceRow * width;
+        uint16_t* out = BAND_PIXEL(band, clip->ca_x0, y);
+
+        if(sourceRow == prevRow)
+            reader = rowReader;
+        else
+            rowReader = reader;
+        prevRow = sourceRow;
+
+        for(int32_t x = clip->ca_x0; x < clip->ca_x1; ++x) {
+            size_t bit = rowBit + (x - op->lo_x) / scale;
+            *out++ = (tft_mask_byte(&reader, bit >> 3) & (0x80 >> (bit & 7))) ? op->lo_fg.word : op->lo_bg.word;
+        }
+    }
+}
+
+void tft_composite_runs(const struct LcdOperation* op, const CompositeBand* band, const CompositeArea* clip) {
+    const uint8_t* data = op->lo_bitmap.bitmap;
+    const size_t width = op->lo_bitmap.width;
+    const uint8_t scale = op->lo_bitmap.scale;
+    size_t offset = 0;
+    // Pixel index where the current run ends, the first run is the background
+    size_t runEnd = 0;
+    uint8_t color = 1;
+    // Scaled rows are read more than once, this is the state at the row start
+    size_t rowOffset = 0, rowRunEnd = 0;
+    uint8_t rowColor = 1;
+    size_t prevRow = SIZE_MAX;
+
+    for(int32_t y = clip->ca_y0; y < clip->ca_y1; ++y) {
+        const size_t sourceRow = (y - op->lo_y) / scale;
+        const size_t rowStart = sourceRow * width;
+        uint16_t* out = BAND_PIXEL(band, clip->ca_x0, y);
+
+        if(sourceRow == prevRow) {
+            offset = rowOffset;
+            runEnd = rowRunEnd;
+            color = rowColor;
+        } else {
+            rowOffset = offset;
+            rowRunEnd = runEnd;
+            rowColor = color;
+        }
+        prevRow = sourceRow;
+
+        for(int32_t x = clip->ca_x0; x < clip->ca_x1; ++x) {
+            const size_t index = rowStart + (x - op->lo_x) / scale;
+            while(index >= runEnd) {
+                runEnd += tft_read_run(data, &offset);
+                color ^= 1;
+            }
+            *out++ = color ? op->lo_fg.word : op->lo_bg.word;
+        }
+    }
+}
+
+void tft_composite_color(const struct LcdOperation* op, const CompositeBand* band, const CompositeArea* clip) {
+    const size_t width = op->lo_bitmap.width;
+    const uint8_t scale = op->lo_bitmap.scale;
+    const uint8_t bpp = op->lo_bitmap.bpp;
+    const size_t stride = (width * bpp + 7) / 8;
+
+    for(int32_t y = clip->ca_y0; y < clip->ca_y1; ++y) {
+        const size_t sy = (y - op->lo_y) / scale;
+        uint16_t* out = BAND_PIXEL(band, clip->ca_x0, y);
+
+        for(int32_t x = clip->ca_x0; x < clip->ca_x1; ++x) {
+            const size_t sx = (x - op->lo_x) / scale;
+            if(op->lo_op == COLOR_BITMAP) {
+                *out++ = ((const uint16_t*)op->lo_bitmap.bitmap)[sy * width + sx];
+            } else {
+                const uint8_t* row = (const uint8_t*)op->lo_bitmap.bitmap + sy * stride;
+                const size_t bit = sx * bpp;
+                const uint8_t index = (row[bit >> 3] >> (8 - bpp - (bit & 7))) & ((1 << bpp) - 1);
+                *out++ = op->lo_bitmap.palette[index].word;
+            }
+        }
+    }
+}
+
+void tft_composite_gradient(const struct LcdOperation* op, const CompositeBand* band, const CompositeArea* clip) {
+    if(op->lo_op == VGRADIENT_FILL) {
+        const size_t length = op->lo_gradient.length ? op->lo_gradient.length : op->lo_gradient.height;
+
+        for(int32_t y = clip->ca_y0; y < clip->ca_y1; ++y) {
+            CompositeArea row = { clip->ca_x0, y, clip->ca_x1, y + 1 };
+            tft_composite_fill(band, &row, tft_gradient_color(op, op->lo_gradient.offset + y - op->lo_y, length).word);
+        }
+    } else {
+        // Every row is the same, the first one is copied down
+        uint16_t* first = BAND_PIXEL(band, clip->ca_x0, clip->ca_y0);
+        for(int32_t x = clip->ca_x0; x < clip->ca_x1; ++x)
+            first[x - clip->ca_x0] = tft_gradient_color(op, x - op->lo_x, op->lo_gradient.width).word;
+        for(int32_t y = clip->ca_y0 + 1; y < clip->ca_y1; ++y)
+            memcpy(BAND_PIXEL(band, clip->ca_x0, y), first, (clip->ca_x1 - clip->ca_x0) * sizeof(uint16_t));
+    }
+}
+
+// Keyed shapes only draw their spans
+void tft_composite_shape(const struct LcdOperation* op, const CompositeBand* band, const CompositeArea* clip, uint8_t keyed) {
+    ShapeSpan spans[SHAPE_MAX_SPANS];
+
+    for(int32_t y = clip->ca_y0; y < clip->ca_y1; ++y) {
+        if(!keyed) {
+            CompositeArea row = { clip->ca_x0, y, clip->ca_x1, y + 1 };
+            tft_composite_fill(band, &row, op->lo_bg.word);
+        }
+
+        size_t count = tft_shape_spans(op, y - op->lo_y, op->lo_shape.width, spans);
+        for(size_t i = 0; i < count; ++i) {
+            int32_t start = op->lo_x + spans[i].ss_start;
+            int32_t end = op->lo_x + spans[i].ss_end;
+            if(start < clip->ca_x0)
+                start = clip->ca_x0;
+            if(end > clip->ca_x1)
+                end = clip->ca_x1;
+
+            CompositeArea span = { start, y, end, y + 1 };
+            if(start < end)
+                tft_composite_fill(band, &span, op->lo_fg.word);
+        }
+    }
+}
+
+/**
+ * @brief Composite operation
+ * Draws the part of an operation which lies inside of the band.
+ *
+ * @param op Operation
+ * @param band Band
+ * @param keyed Draw only the foreground of text and shapes
+ */
+void tft_composite_op(const struct LcdOperation* op, const CompositeBand* band, uint8_t keyed) {
+    uint16_t width, height;
+    if(!tft_operation_size(op, &width, &height))
+        return;
+
+    CompositeArea clip = band->cb_area;
+    if(op->lo_x > clip.ca_x0)
+        clip.ca_x0 = op->lo_x;
+    if(op->lo_y > clip.ca_y0)
+        clip.ca_y0 = op->lo_y;
+    if(op->lo_x + width < clip.ca_x1)
+        clip.ca_x1 = op->lo_x + width;
+    if(op->lo_y + height < clip.ca_y1)
+        clip.ca_y1 = op->lo_y + height;
+    if(clip.ca_x0 >= clip.ca_x1 || clip.ca_y0 >= clip.ca_y1)
+        return;
+
+    switch(op->lo_op) {
+        case RECT_FILL:
+            tft_composite_fill(band, &clip, op->lo_fg.word);
+            break;
+        case TEXT:
+            tft_composite_text(op, band, &clip, keyed);
+            break;
+        case BITMAP:
+        case RLE_BITMAP:
+            tft_composite_mask(op, band, &clip);
+            break;
+        case COLOR_BITMAP:
+        case PALETTE_BITMAP:
+            tft_composite_color(op, band, &clip);
+            break;
+        case RUN_BITMAP:
+            tft_composite_runs(op, band, &clip);
+            break;
+        case VGRADIENT_FILL:
+        case HGRADIENT_FILL:
+            tft_composite_gradient(op, band, &clip);
+            break;
+        case LINE:
+        case CIRCLE:
+        case ARC:
+        case ROUND_RECT:
+            tft_composite_shape(op, band, &clip, keyed);
+            break;
+        case PLOT: {
+            // Sweep plot operations start at column `first` of the box
+            const int32_t x = op->lo_x - op->lo_plot.first;
+            tft_plot_area(op->lo_plot.plot, op->lo_fg, op->lo_bg, BAND_PIXEL(band, clip.ca_x0, clip.ca_y0),
+                band->cb_area.ca_x1 - band->cb_area.ca_x0, clip.ca_x0 - x, clip.ca_y0 - op->lo_y, clip.ca_x1 - x, clip.ca_y1 - op->lo_y);
+        } break;
+        default:
+            // Nested composites aren't supported
+            break;
+    }
+}
+
+/**
+ * @brief Find tile hash
+ *
+ * @return TileHash* Hash of the exact area or 0
+ */
+TileHash* tft_find_tile(uint16_t x, uint16_t y, uint16_t width, uint16_t height) {
+    for(size_t i = 0; i < LCD_TILE_SLOTS; ++i) {
+        TileHash* tile = &tft_tileHashes[i];
+        if(tile->th_width == width && tile->th_x == x && tile->th_y == y && tile->th_height == height)
+            return tile;
+    }
+    return 0;
+}
+
+void tft_store_tile(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint32_t crc) {
+    TileHash* tile = tft_find_tile(x, y, width, height);
+    for(size_t i = 0; i < LCD_TILE_SLOTS && !tile; ++i) {
+        if(!tft_tileHashes[i].th_width)
+            tile = &tft_tileHashes[i];
+    }
+    if(!tile) {
+        // Table is full, replace the oldest slot
+        tile = &tft_tileHashes[tft_tileNext];
+        tft_tileNext = (tft_tileNext + 1) % LCD_TILE_SLOTS;
+    }
+
+    tile->th_x = x;
+    tile->th_y = y;
+    tile->th_width = width;
+    tile->th_height = height;
+    tile->th_crc = crc;
+}
+
+uint32_t tft_tile_crc(const uint16_t* pixels, size_t count) {
+    // Bands start on any halfword, the CRC unit reads whole words
+    uint32_t words[LCD_CRC_CHUNK];
+    uint32_t crc = 0;
+
+    for(size_t done = 0; done < count; ) {
+        size_t length = count - done;
+        if(length > LCD_CRC_CHUNK * 2)
+            length = LCD_CRC_CHUNK * 2;
+
+        // An odd pixel at the end is padded with zeros
+        if(length & 1)
+            words[length / 2] = 0;
+        memcpy(words, pixels + done, length * sizeof(uint16_t));
+        if(done)
+            crc = HAL_CRC_Accumulate(&tft_crc, words, (length + 1) / 2);
+        else
+            crc = HAL_CRC_Calculate(&tft_crc, words, (length + 1) / 2);
+        done += length;
+    }
+    return crc;
+}
+
+/**
+ * @brief Render composite
+ * Draws every operation of the composite which intersects the next tile
+ * into the line buffer in order, so overlapping operations don't send
+ * their pixels more than once. Tiles are bands of LCD_TILE_ROWS rows
+ * aligned to the screen, a tile is only sent if its CRC differs from
+ * the one sent last time. Consecutive changed tiles are sent together.
+ *
+ * @param op Operation
+ */
+void tft_render_composite(struct LcdOperation* op) {
+    size_t width = op->lo_composite.width;
+    size_t height = op->lo_composite.height;
+    size_t row = op->lo_composite.row;
+
+    // Clip the area to the screen
+    if(op->lo_x >= TFT_WIDTH || op->lo_y >= TFT_HEIGHT) {
+        tft_lcd_dma_complete();
+        return;
+    }
+    if(op->lo_x + width > TFT_WIDTH)
+        width = TFT_WIDTH - op->lo_x;
+    if(op->lo_y + height > TFT_HEIGHT)
+        height = TFT_HEIGHT - op->lo_y;
+
+    const size_t maxRows = LCD_BUFFER_SIZE / width;
+    uint16_t tileY[LCD_TILE_RUN];
+    uint16_t tileRows[LCD_TILE_RUN];
+    uint32_t tileCrc[LCD_TILE_RUN];
+    size_t tiles = 0;
+    size_t rows = 0;
+    // Rows of an unchanged tile right after the sent ones
+    size_t skipRows = 0;
+    size_t skipped = 0;
+
+    while(width && row + rows < height && tiles < LCD_TILE_RUN) {
+        const uint16_t y = op->lo_y + row + rows;
+        size_t count = LCD_TILE_ROWS - y % LCD_TILE_ROWS;
+        if(count > height - row - rows)
+            count = height - row - rows;
+        if(rows + count > maxRows)
+            break;
+
+        // Members are drawn in their own coordinates, moved down by the shift
+        const int32_t memberY = y - op->lo_composite.shift;
+        const CompositeBand band = { tft_lcdBuffer + rows * width, { op->lo_x, memberY, op->lo_x + width, memberY + count } };
+
+        // The first operation covers the whole area, the rest can be keyed
+        for(size_t i = 0; i < op->lo_composite.count; ++i)
+            tft_composite_op(op->lo_composite.ops + i, &band, i > 0);
+
+        const uint32_t crc = tft_tile_crc(band.cb_out, width * count);
+        const TileHash* tile = tft_find_tile(op->lo_x, y, width, count);
+        ++tft_tileStats.lts_hashed;
+
+        if(tile && tile->th_crc == crc) {
+            ++tft_tileStats.lts_skipped;
+            if(rows) {
+                skipRows = count;
+                break;
+            }
+            // Nothing to send yet, draw the next tile in the same place
+            row += count;
+            if(++skipped >= LCD_TILE_SKIP_MAX)
+                break;
+            continue;
+        }
+
+        tileY[tiles] = y;
+        tileRows[tiles] = count;
+        tileCrc[tiles++] = crc;
+        rows += count;
+    }
+
+    if(!rows) {
+        if(width && row < height) {
+            // Don't rasterize a long unchanged area in the interrupt
+            struct LcdOperation* cont = tft_new_continuation(COMPOSITE);
+            cont->lo_x = op->lo_x;
+            cont->lo_y = op->lo_y;
+            cont->lo_composite = op->lo_composite;
+            cont->lo_composite.row = row;
+            tft_insert_next(cont);
+            tft_yield_render();
+            return;
+        }
+
+        // Everything left is unchanged
+        tft_lcd_dma_complete();
+        return;
+    }
+
+    const uint16_t y = op->lo_y + row;
+    tft_set_window(op->lo_x, y, op->lo_x + width - 1, y + rows - 1);
+    // Setting the window dropped the old hashes of these tiles
+    for(size_t i = 0; i < tiles; ++i)
+        tft_store_tile(op->lo_x, tileY[i], width, tileRows[i], tileCrc[i]);
+
+    if(row + rows + skipRows < height) {
+        struct LcdOperation* cont = tft_new_continuation(COMPOSITE);
+        cont->lo_x = op->lo_x;
+        cont->lo_y = op->lo_y;
+        cont->lo_composite = op->lo_composite;
+        cont->lo_composite.row = row + rows + skipRows;
+        tft_insert_next(cont);
+    }
+
+    tft_dma_memmode(1);
+    tft_lcd_dma(tft_lcdBuffer, width * rows);
+}
+
+LcdTileStats tft_take_tile_stats() {
+    QUEUE_LOCK();
+    LcdTileStats stats = tft_tileStats;
+    memset(&tft_tileStats, 0, sizeof(tft_tileStats));
+    QUEUE_UNLOCK();
+    return stats;
+}
+
+void tft_invalidate_tiles() {
+    QUEUE_LOCK();
+    memset(tft_tileHashes, 0, sizeof(tft_tileHashes));
+    QUEUE_UNLOCK();
+}
+
+void tft_render_op(struct LcdOperation* op) {
+    switch(op->lo_op) {
+        case RECT_FILL: {
+            size_t modifiedPixels = op->lo_rect.width * op->lo_rect.height;
+            if(modifiedPixels > LCD_FILL_CHUNK) {
+                size_t maxLines = (LCD_FILL_CHUNK) / op->lo_rect.width;
+
+                modifiedPixels = maxLines * op->lo_rect.width;
+                tft_set_window(op->lo_x, op->lo_y, op->lo_x + op->lo_rect.width - 1, op->lo_y + maxLines - 1);
+
+                struct LcdOperation* fillContinue = tft_new_continuation(RECT_FILL);
+                fillContinue->lo_x = op->lo_x;
+                fillContinue->lo_y = op->lo_y + maxLines;
+                fillContinue->lo_rect.width = op->lo_rect.width;
+                fillContinue->lo_rect.height = op->lo_rect.height - maxLines;
+                fillContinue->lo_fg = op->lo_fg;
+
+                tft_insert_next(fillContinue);
+            } else {
+                tft_set_window(op->lo_x, op->lo_y, op->lo_x + op->lo_rect.width - 1, op->lo_y + op->lo_rect.height - 1);
+            }
+
+            tft_dma_memmode(0);
+            tft_lcd_dma(&op->lo_fg, modifiedPixels);
+        } break;
+        case TEXT:
+            tft_render_text(op);
+            break;
+        case BITMAP:
+            tft_render_bitmap(op);
+            break;
+        case BITMAP_CONTINUE:
+            tft_render_cont_bitmap(op);
+            break;
+        case RLE_BITMAP:
+            tft_render_bitmap_rle(op);
+            break;
+        case RLE_BITMAP_CONTINUE:
+            tft_render_cont_bitmap_rle(op);
+            break;
+        case COLOR_BITMAP:
+            tft_render_color_bitmap(op);
+            break;
+        case PALETTE_BITMAP:
+            tft_render_palette_bitmap(op);
+            break;
+        case RUN_BITMAP:
+            // Foreground with nothing left, the first run is the background
+            tft_render_runs(op, 0, 1, 0);
+            break;
+        case RUN_BITMAP_CONTINUE:
+            tft_render_runs(op, op->lo_bitmap_cont.bitmapOffset, op->lo_bitmap_cont.bits, op->lo_bitmap_cont.lengthLeft);
+            break;
+        case VGRADIENT_FILL:
+            tft_render_vgradient(op);
+            break;
+        case HGRADIENT_FILL:
+            tft_render_hgradient(op);
+            break;
+        case LINE:
+        case CIRCLE:
+        case ARC:
+        case ROUND_RECT:
+            tft_render_shape(op);
+            break;
+        case PLOT:
+            tft_render_plot(op);
+            break;
+        case SCROLL:
+            tft_set_scroll(op->lo_scroll.top, op->lo_scroll.height, op->lo_scroll.start);
+            tft_lcd_dma_complete();
+            break;
+        case COMPOSITE:
+            tft_render_composite(op);
+            break;
+        case CONST_ARRAY:
+        case CALLBACK:
+            // Nested arrays and callbacks inside of arrays are not supported, skip it
+            tft_lcd_dma_complete();
+            break;
+    }
+}
+
+/********** End of rendering functions **********/
+
+__attribute__((weak)) void tft_render_finished() { }
+
+/**
+ * @brief Render next operation
+ * Takes the next operation out of the queue and starts rendering it,
+ * finishes the render if there are no more operations left.
+ */
+void tft_render_next() {
+    struct LcdOperation* op = tft_next_operation();
+    tft_currentOp = op;
+
+    if(op) {
+        tft_render_op(op);
+    } else {
+        // Finish the transfer
+        LCD_DESELECT();
+        tft_rendering = 0;
+
+        tft_render_finished();
+    }
+}
+
+void tft_tp_read();
+
+void tft_lcd_dma_complete() {
+    // The current operation is already out of the queue
+    struct LcdOperation* oldOp = tft_currentOp;
+    tft_currentOp = 0;
+    // Don't free static operations
+    if(!oldOp->lo_static)
+        free(oldOp);
+
+    // Wait for SPI to finish doing it's thing
+    SPI_WAIT_NBSY();
+
+    if(tft_tpDeferred) {
+        // The bus is free between chunks, read the touch panel now
+        tft_tpDeferred = 0;
+        LCD_DESELECT();
+        tft_tp_read();
+    }
+
+    tft_render_next();
+}
+
+/**
+ * @brief Yield render
+ * Finishes the current operation without a transfer and stops, the rest
+ * of the queue is rendered once tft_main_loop() (or tft_start_render())
+ * is called. Used by operations which already spent long in the interrupt.
+ */
+void tft_yield_render() {
+    struct LcdOperation* oldOp = tft_currentOp;
+    tft_currentOp = 0;
+    if(!oldOp->lo_static)
+        free(oldOp);
+
+    SPI_WAIT_NBSY();
+    LCD_DESELECT();
+    tft_renderYielded = 1;
+    tft_rendering = 0;
+}
+
+void tft_start_render() {
+    if(!tft_rendering && (tft_lcdOperations || tft_priorityOps)) {
+        tft_rendering = 1;
+        tft_render_next();
+    }
+}
+
+void tft_driver_init() {
+    /************ Configure on-chip peripherals **************/
+
+    // Enable clocks
+    __HAL_RCC_GPIOA_CLK_ENABLE();
+    __HAL_RCC_GPIOB_CLK_ENABLE();
+    __HAL_RCC_SPI1_CLK_ENABLE();
+    __HAL_RCC_DMA2_CLK_ENABLE();
+    __HAL_RCC_CRC_CLK_ENABLE();
+
+    // Initialize the GPIO
+    GPIO_InitTypeDef GpioOut;
+    GpioOut.Pin = LCD_SS;
+    GpioOut.Mode = GPIO_MODE_OUTPUT_PP;
+    GpioOut.Pull = GPIO_NOPULL;
+    GpioOut.Speed = GPIO_SPEED_HIGH;
+    HAL_GPIO_Init(GPIOA, &GpioOut);
+
+    GpioOut.Pin = LCD_DC | LCD_RST | TP_SS;
+    HAL_GPIO_Init(GPIOB, &GpioOut);
+
+    GPIO_InitTypeDef GpioAf;
+    GpioAf.Pin = LCD_MOSI | LCD_MISO;
+    GpioAf.Mode = GPIO_MODE_AF_PP;
+    GpioAf.Pull = GPIO_NOPULL;
+    GpioAf.Speed = GPIO_SPEED_HIGH;
+    GpioAf.Alternate = 5;
+    HAL_GPIO_Init(GPIOA, &GpioAf);
+
+    GpioAf.Pin = LCD_SCK;
+    GpioAf.Pull = GPIO_PULLDOWN;
+    HAL_GPIO_Init(GPIOA, &GpioAf);
+
+    TP_DESELECT();
+    LCD_DESELECT();
+    LCD_DEASSERT_RST();
+    LCD_DELAY(5);
+
+    // Initialize the SPI interface
+    __HAL_RCC_SPI1_FORCE_RESET();
+    __HAL_RCC_SPI1_RELEASE_RESET();
+
+    // Initialize the SPI interface
     tft_lcdSPI.Instance = SPI1;
     tft_lcdSPI.Init.Mode = SPI_MODE_MASTER;
     tft_lcdSPI.Init.CLKPolarity = SPI_POLARITY_LOW;
@@ -699,6 +2637,10 @@ void tft_driver_init() {
     HAL_DMA_Init(&tft_lcdDMA);
     __HAL_LINKDMA(&tft_lcdSPI, hdmatx, tft_lcdDMA);
 
+    // CRC unit hashes composite tiles
+    tft_crc.Instance = CRC;
+    HAL_CRC_Init(&tft_crc);
+
     // Setup DMA interrupts
     HAL_NVIC_SetPriority(DMA2_Stream2_IRQn, 3, 0);
     HAL_NVIC_EnableIRQ(DMA2_Stream2_IRQn);
@@ -762,7 +2704,19 @@ __attribute__((weak)) void tft_touch_cb(uint16_t x, uint16_t y) {
     UNUSED(y);
 }
 
+__attribute__((weak)) void tft_drag_cb(uint16_t x, uint16_t y) {
+    UNUSED(x);
+    UNUSED(y);
+}
+
+__attribute__((weak)) void tft_release_cb() { }
+
 void tft_main_loop() {
+    if(tft_renderYielded) {
+        tft_renderYielded = 0;
+        tft_start_render();
+    }
+
     if(tft_tpPending) {
         uint16_t startX, endX, startY, endY;
         uint8_t flipX, flipY;
@@ -792,10 +2746,30 @@ void tft_main_loop() {
         if(flipY)
             tY = TFT_HEIGHT - tY;
 
-        if(tX <= TFT_WIDTH && tY <= TFT_HEIGHT)
-            tft_touch_cb(tX, tY);
+        if(tX <= TFT_WIDTH && tY <= TFT_HEIGHT) {
+            if(tft_tpPressed) {
+                tft_drag_cb(tX, tY);
+            } else {
+                tft_tpPressed = 1;
+                tft_touch_cb(tX, tY);
+            }
+            tft_tpDragTick = HAL_GetTick();
+        }
         tft_tpPending = 0;
     }
+
+    if(tft_tpPressed && !tft_tpPending && HAL_GPIO_ReadPin(GPIOB, TP_INT) == GPIO_PIN_SET) {
+        // Pen interrupt line goes high once the panel is released
+        tft_tpPressed = 0;
+        tft_release_cb();
+    } else if(tft_tpPressed && !tft_tpPending && !tft_tpDeferred && HAL_GetTick() - tft_tpDragTick >= TP_DRAG_INTERVAL) {
+        // The pen interrupt only fires when the panel is pressed, sample the held touch
+        tft_tpDragTick = HAL_GetTick();
+        if(tft_rendering)
+            tft_tpDeferred = 1;
+        else
+            tft_tp_read();
+    }
 }
 
 void tft_tp_irq() {
@@ -806,10 +2780,19 @@ void tft_tp_irq() {
     }
 
     if(tft_rendering) {
-        // We ignore the touch if a render is in progress
+        // The bus is busy, read the touch between two render chunks
+        tft_tpDeferred = 1;
         return;
     }
 
+    tft_tp_read();
+}
+
+/**
+ * @brief Read touch panel
+ * Reads the touch position, the SPI can't be in use by the LCD.
+ */
+void tft_tp_read() {
     tft_lcdSPI.Init.BaudRatePrescaler = SPI_BAUDRATEPRESCALER_256;
     tft_lcdSPI.Init.DataSize = SPI_DATASIZE_8BIT;
     HAL_SPI_Init(&tft_lcdSPI);
@@ -15,10 +15,11 @@ extern "C" {
 
 typedef union LcdColor_t {
     uint16_t word;
+    // Same layout as TFT_COLOR, the lowest green bit is left out
     struct {
         uint16_t r:5;
-        uint16_t g:5;
         uint16_t zero:1;
+        uint16_t g:5;
         uint16_t b:5;
     };
 } LcdColor;
@@ -40,29 +41,63 @@ typedef union LcdColor_t {
 
 #define FONT_Y_OFFSET 6
 
-static inline LcdColor tft_colmul(LcdColor color, float scalar) {
-    LcdColor result;
-    result.r = (float)color.r * scalar;
-    result.g = (float)color.g * scalar;
-    result.b = (float)color.b * scalar;
-    return result;
-}
-
 typedef enum LcdOperationEnum_t {
     RECT_FILL,
     TEXT,
     BITMAP,
     BITMAP_CONTINUE,
     RLE_BITMAP,
-    RLE_BITMAP_CONTINUE
+    RLE_BITMAP_CONTINUE,
+    COLOR_BITMAP,
+    PALETTE_BITMAP,
+    RUN_BITMAP,
+    RUN_BITMAP_CONTINUE,
+    VGRADIENT_FILL,
+    HGRADIENT_FILL,
+    LINE,
+    CIRCLE,
+    ARC,
+    ROUND_RECT,
+    PLOT,
+    SCROLL,
+    COMPOSITE,
+    CONST_ARRAY,
+    CALLBACK
 } LcdOperationEnum;
 
+// Scroll mode, time runs down the rows of a full width plot (sweep mode runs along the columns)
+#define PLOT_SCROLL 0x01
+
+// Samples of a plot, drawn by PLOT operations straight out of the ring buffer.
+// Sweep plots show sample i in column i + 1 of the box, scrolling plots
+// show it in row i and scroll the panel so that the newest row is at the bottom.
+typedef struct LcdPlot_t {
+    int16_t* lp_samples;
+    uint16_t lp_capacity;
+    // Next sample is written here, this column (or row) is left empty
+    uint16_t lp_head;
+    // Number of valid samples, saturates at lp_capacity
+    uint16_t lp_count;
+    // Values mapped to the bottom (left) and top (right) edge of the plot
+    int16_t lp_min;
+    int16_t lp_max;
+    // Plot box, the axes are drawn in the first column and the last row
+    uint16_t lp_width;
+    uint16_t lp_height;
+    LcdColor lp_gridColor;
+    LcdColor lp_axisColor;
+    // Grid line spacing in pixels, 0 disables the grid
+    uint16_t lp_gridStep;
+    uint8_t lp_flags;
+} LcdPlot;
+
 struct LcdOperation {
     LcdOperationEnum lo_op;
     LcdColor lo_fg;
     LcdColor lo_bg;
 
     char lo_static;
+    char lo_queued;
     struct LcdOperation* lo_next;
 
     uint16_t lo_x;
@@ -82,6 +117,9 @@ struct LcdOperation {
             uint16_t height;
             const void* bitmap;
             uint8_t scale;
+            // Only used by PALETTE_BITMAP
+            const LcdColor* palette;
+            uint8_t bpp;
         } lo_bitmap;
         struct {
             uint16_t width;
@@ -93,11 +131,128 @@ struct LcdOperation {
             uint8_t mask;
             size_t lengthLeft;
         } lo_bitmap_cont;
+        // Gradient from lo_fg (top or left) to lo_bg (bottom or right)
+        struct {
+            uint16_t width;
+            uint16_t height;
+            // Full gradient length and position of this operation in it,
+            // only used by vertical gradients split into bands
+            uint16_t length;
+            uint16_t offset;
+        } lo_gradient;
+        // Shapes are drawn with lo_fg over lo_bg and clipped to the box
+        struct {
+            uint16_t width;
+            uint16_t height;
+            // Line start or circle center, relative to the box
+            int16_t x0;
+            int16_t y0;
+            // Line end, or arc start and end angle in degrees
+            // (clockwise from 3 o'clock, the same angles draw a full ring)
+            int16_t x1;
+            int16_t y1;
+            // Circle, arc or corner radius
+            uint16_t radius;
+            // Outline thickness, 0 draws filled shapes
+            uint8_t thickness;
+            // Next run of the next row, only used by continuations
+            uint8_t run;
+            uint16_t row;
+        } lo_shape;
+        // Trace is drawn with lo_fg over lo_bg, lo_x and lo_y are the top left
+        // corner of the drawn area (not of the whole plot box)
+        struct {
+            uint16_t width;
+            uint16_t height;
+            const LcdPlot* plot;
+            // First column (row when scrolling) of the plot box in this operation
+            uint16_t first;
+            // Row of the scroll area shown at the top of the screen
+            uint16_t top;
+        } lo_plot;
+        // Sets the vertical scroll area (rows top to top + height - 1), the
+        // content of row `start` is shown at the top of the area
+        struct {
+            uint16_t top;
+            uint16_t height;
+            uint16_t start;
+        } lo_scroll;
+        // Operations inside of the area (lo_x, lo_y, width, height) drawn in RAM
+        // band by band, the first one has to cover the whole area.
+        struct {
+            const struct LcdOperation* ops;
+            size_t count;
+            uint16_t width;
+            uint16_t height;
+            // First row of the next band, only used by continuations
+            uint16_t row;
+            // Members are drawn this many rows lower
+            int16_t shift;
+        } lo_composite;
+        struct {
+            const struct LcdOperation* ops;
+            size_t count;
+            size_t index;
+        } lo_array;
+        struct {
+            void (*function)(void* arg);
+            void* arg;
+        } lo_callback;
     };
 };
 
+// Color bitmaps are sent as they are, their assets are never scaled
+#define TFT_ASSET_SCALE(format, scale) ((format) == COLOR_BITMAP ? 1 : (scale))
+
+// Entry of an asset pack generated by asset_pack.py
+typedef struct LcdAsset_t {
+    // Bitmap operation which draws the asset, TEXT for fonts
+    LcdOperationEnum la_format;
+    uint16_t la_width;
+    uint16_t la_height;
+    // Bitmap data or a pointer to the BitmapFont
+    const void* la_data;
+    const LcdColor* la_palette;
+    uint8_t la_bpp;
+    uint32_t la_size;
+} LcdAsset;
+
+typedef struct LcdTileStats_t {
+    // Composite tiles hashed and tiles which weren't sent because they didn't change
+    uint32_t lts_hashed;
+    uint32_t lts_skipped;
+} LcdTileStats;
+
 extern void tft_driver_init(void);
 
+/**
+ * @brief Create asset operation
+ * Fills in a bitmap operation which draws an image asset, 1bpp assets
+ * (BITMAP, RLE_BITMAP and RUN_BITMAP) are drawn with lo_fg and lo_bg
+ * which have to be set by the caller. Font assets fill in a TEXT
+ * operation, the caller sets the text.
+ *
+ * @param op Operation to fill in
+ * @param asset Image or font asset
+ * @param x Left edge
+ * @param y Top edge (baseline for fonts)
+ * @param scale Integer scale, see TFT_ASSET_SCALE
+ */
+extern void tft_asset_operation(struct LcdOperation* op, const LcdAsset* asset, uint16_t x, uint16_t y, uint8_t scale);
+
+/**
+ * @brief Get operation size
+ * Calculates the size of the area an operation writes to, text
+ * is measured the same way the text renderer does it.
+ *
+ * @param op Operation
+ * @param width Output width
+ * @param height Output height
+ * @return uint8_t 1 if the whole area is overwritten (opaque),
+ *                 0 if the operation doesn't have a known area
+ */
+extern uint8_t tft_operation_size(const struct LcdOperation* op, uint16_t* width, uint16_t* height);
+
 /**
  * @brief Create new LCD operation
  * Allocates and returns a pointer to an LCD operation structure
@@ -109,12 +264,55 @@ extern struct LcdOperation* tft_new_operation(LcdOperationEnum operation);
 
 /**
  * @brief Submit LCD operation
- * Submits an LCD operation to the render queue.
+ * Submits an LCD operation to the render queue. If the operation
+ * is already waiting in the queue it is left where it is, it will
+ * be rendered with whatever contents it has when it is reached.
  *
  * @param op Operation to submit
  */
 extern void tft_submit(struct LcdOperation* op);
 
+/**
+ * @brief Check if an operation is busy
+ * An operation which is queued or being rendered can't be modified.
+ *
+ * @param op Operation
+ * @return uint8_t 1 if the operation is busy
+ */
+extern uint8_t tft_operation_busy(const struct LcdOperation* op);
+
+/**
+ * @brief Submit priority LCD operation
+ * Submits an operation to the priority lane, it is rendered at the next
+ * chunk boundary of whatever is being rendered now (before the rest of
+ * the queue). Meant for small, latency critical operations like touch
+ * feedback, a render still has to be started with tft_start_render().
+ *
+ * @param op Operation to submit
+ */
+extern void tft_submit_priority(struct LcdOperation* op);
+
+/**
+ * @brief Submit completion callback
+ * Queues a callback which is called (from the DMA interrupt) once
+ * all operations submitted before it have been sent to the display.
+ *
+ * @param function Callback function
+ * @param arg Argument passed to the callback
+ */
+extern void tft_submit_callback(void (*function)(void* arg), void* arg);
+
+/**
+ * @brief Cancel LCD operation
+ * Takes a queued operation out of the render queue (it is not freed),
+ * after this the operation can be safely modified and submitted again.
+ *
+ * @param op Operation to cancel
+ * @return int 1 if the operation was removed, 0 if it wasn't queued,
+ *             -1 if it is being rendered right now
+ */
+extern int tft_cancel(struct LcdOperation* op);
+
 /**
  * @brief Submit LCD operations
  * Submits multiple LCD operations to the render queue,
@@ -125,6 +323,17 @@ extern void tft_submit(struct LcdOperation* op);
  */
 extern void tft_submit_multiple(struct LcdOperation* ops, size_t count);
 
+/**
+ * @brief Submit constant LCD operations
+ * Submits an array of operations which can't be modified (e.g. placed
+ * in flash), every operation is copied into RAM just before it is
+ * rendered. The array can't contain any CONST_ARRAY operations.
+ *
+ * @param ops Array of operations
+ * @param count Length of the array
+ */
+extern void tft_submit_const(const struct LcdOperation* ops, size_t count);
+
 /**
  * @brief Start render
  * Renders all queued operations onto the display, all
@@ -133,6 +342,23 @@ extern void tft_submit_multiple(struct LcdOperation* ops, size_t count);
  */
 extern void tft_start_render();
 
+/**
+ * @brief Take tile statistics
+ * Returns the tile counters collected since the last call and resets
+ * them, calling it once per frame gives the per-frame numbers.
+ *
+ * @return LcdTileStats Tile counters
+ */
+extern LcdTileStats tft_take_tile_stats();
+
+/**
+ * @brief Invalidate tile hashes
+ * Forgets the hashes of all tiles, so the next composites are sent in
+ * full. Has to be called when the panel content changes without the
+ * driver knowing about it (e.g. the panel was reset).
+ */
+extern void tft_invalidate_tiles();
+
 /**
  * @brief Recalibrate TouchPanel
  * This function will start the touch panel calibration procedure,
@@ -143,10 +369,22 @@ extern void tft_recalibrate_tp();
 /**
  * @brief TFT event loop
  * This method has to be periodically called to service
- * any touch events that happen.
+ * any touch events that happen. It also continues renders
+ * which stopped to leave the interrupt early.
  */
 extern void tft_main_loop();
 
+/**
+ * @brief Touch callbacks
+ * Weak functions which can be overridden (the gfx library does), the touch
+ * callback gets the first position of a touch, the drag callback gets the
+ * positions of a held touch (read every TP_DRAG_INTERVAL ms) and the release
+ * callback is called when the panel is released. Called from tft_main_loop().
+ */
+extern void tft_touch_cb(uint16_t x, uint16_t y);
+extern void tft_drag_cb(uint16_t x, uint16_t y);
+extern void tft_release_cb();
+
 /**
  * @brief TouchPanel interrupt handler
  * You should register this method as the interrupt
@@ -0,0 +1,17 @@
+#include "tft_expand.h"
+
+// Halfword mask of bit `bit` placed at halfword `half`
+#define HALF(byte, bit, half) ((((byte) >> (bit)) & 1) * (0xFFFFU << ((half) * 16)))
+#define ENTRY(byte) { \
+    HALF(byte, 7, 0) | HALF(byte, 6, 1), \
+    HALF(byte, 5, 0) | HALF(byte, 4, 1), \
+    HALF(byte, 3, 0) | HALF(byte, 2, 1), \
+    HALF(byte, 1, 0) | HALF(byte, 0, 1) }
+
+#define ENTRIES4(byte) ENTRY(byte), ENTRY((byte) + 1), ENTRY((byte) + 2), ENTRY((byte) + 3)
+#define ENTRIES16(byte) ENTRIES4(byte), ENTRIES4((byte) + 4), ENTRIES4((byte) + 8), ENTRIES4((byte) + 12)
+#define ENTRIES64(byte) ENTRIES16(byte), ENTRIES16((byte) + 16), ENTRIES16((byte) + 32), ENTRIES16((byte) + 48)
+
+const uint32_t tft_expandLut[256][4] = {
+    ENTRIES64(0), ENTRIES64(64), ENTRIES64(128), ENTRIES64(192)
+};
@@ -0,0 +1,98 @@
+#ifndef TFT_EXPAND_H
+#define TFT_EXPAND_H
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * 1bpp to RGB565 expansion kernels
+ * Every kernel turns a byte of mask bits (MSB first) into eight pixels,
+ * set bits become the foreground color. Colors are passed as pixel pairs
+ * (the color word in both halfwords), see TFT_PIXEL_PAIR.
+ */
+
+#define LCD_EXPAND_C 0
+#define LCD_EXPAND_LUT 1
+#define LCD_EXPAND_DSP 2
+
+// Kernel used by the rasterizers, the DSP one needs the Cortex-M4 SIMD instructions
+#ifndef LCD_EXPAND_KERNEL
+#if defined(__ARM_FEATURE_SIMD32)
+#define LCD_EXPAND_KERNEL LCD_EXPAND_DSP
+#else
+#define LCD_EXPAND_KERNEL LCD_EXPAND_C
+#endif
+#endif
+
+#define TFT_PIXEL_PAIR(word) ((uint32_t)(word) * 0x00010001U)
+
+// Halfword masks of every byte value, 4 pixel pairs per entry
+extern const uint32_t tft_expandLut[256][4];
+
+// Rows don't have to start on a word boundary, memcpy becomes a single
+// (unaligned) store on the M4
+static inline void tft_store_pair(uint16_t* out, uint32_t pair) {
+    memcpy(out, &pair, sizeof(pair));
+}
+
+static inline void tft_expand8_c(uint16_t* out, uint8_t bits, uint32_t fgPair, uint32_t bgPair) {
+    const uint16_t bg = bgPair;
+    const uint16_t diff = fgPair ^ bgPair;
+
+    for(int i = 0; i < 8; ++i)
+        out[i] = bg ^ (diff & -((bits >> (7 - i)) & 1));
+}
+
+static inline void tft_expand8_lut(uint16_t* out, uint8_t bits, uint32_t fgPair, uint32_t bgPair) {
+    const uint32_t* masks = tft_expandLut[bits];
+    const uint32_t diff = fgPair ^ bgPair;
+
+    for(int i = 0; i < 4; ++i)
+        tft_store_pair(out + i * 2, bgPair ^ (diff & masks[i]));
+}
+
+#if defined(__ARM_FEATURE_SIMD32)
+static inline void tft_expand8_dsp(uint16_t* out, uint8_t bits, uint32_t fgPair, uint32_t bgPair) {
+    for(int i = 0; i < 4; ++i) {
+        // First pixel of the pair in bit 0, second one in bit 16
+        uint32_t select = ((bits >> (7 - i * 2)) | ((uint32_t)bits << (10 + i * 2))) & 0x00010001U;
+        uint32_t pair;
+
+        // USUB16 sets the GE flags of halfwords which are not 0, SEL picks the foreground there
+        __asm__("usub16 %0, %1, %2\n\t"
+                "sel %0, %3, %4"
+                : "=&r"(pair)
+                : "r"(select), "r"(0x00010001U), "r"(fgPair), "r"(bgPair)
+                : "cc");
+        tft_store_pair(out + i * 2, pair);
+    }
+}
+#endif
+
+/**
+ * @brief Expand 8 pixels
+ *
+ * @param out Output pixels
+ * @param bits Mask bits, MSB is the first pixel
+ * @param fgPair Foreground color pair
+ * @param bgPair Background color pair
+ */
+static inline void tft_expand8(uint16_t* out, uint8_t bits, uint32_t fgPair, uint32_t bgPair) {
+#if LCD_EXPAND_KERNEL == LCD_EXPAND_DSP
+    tft_expand8_dsp(out, bits, fgPair, bgPair);
+#elif LCD_EXPAND_KERNEL == LCD_EXPAND_LUT
+    tft_expand8_lut(out, bits, fgPair, bgPair);
+#else
+    tft_expand8_c(out, bits, fgPair, bgPair);
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -10,19 +10,31 @@
 #define LIGHT_BLUE TFT_COLOR(15, 15, 31)
 #define DARK_GRAY TFT_COLOR(4, 4, 4)
 
-const GuiElement header_children[] = {
+GuiElement header_children[] = {
     GUI_TEXT(6, 2, TFT_WHITE, "CNC Controller v1.0.0", FreeSans12pt7b)
 };
 
+// Axis positions in 1/100 mm
+int32_t machine_position[3] = { 0, 0, 0 };
+int32_t work_position[3] = { 0, 0, 0 };
+
 GuiElement position_box_children[] = {
     GUI_BORDER(-1, -1, PARENT_WIDTH(2), PARENT_HEIGHT(2), TFT_CYAN, 1),
 
     GUI_TEXT(4, 4, TFT_WHITE, "Position", FreeSans12pt7b),
     GUI_TEXT_RIGHT(PARENT_WIDTH(-4), 4, TFT_WHITE, "[mm]", FreeSans12pt7b),
 
-    GUI_TEXT(8, 8 + 24 * 1, TFT_RED,   "X: 000.00 000.00", FreeMonoBold12pt7b),
-    GUI_TEXT(8, 8 + 24 * 2, TFT_GREEN, "Y: 000.00 000.00", FreeMonoBold12pt7b),
-    GUI_TEXT(8, 8 + 24 * 3, TFT_BLUE,  "Z: 000.00 000.00", FreeMonoBold12pt7b)
+    GUI_TEXT(8, 8 + 24 * 1, TFT_RED,   "X:", FreeMonoBold12pt7b),
+    GUI_TEXT(8, 8 + 24 * 2, TFT_GREEN, "Y:", FreeMonoBold12pt7b),
+    GUI_TEXT(8, 8 + 24 * 3, TFT_BLUE,  "Z:", FreeMonoBold12pt7b),
+
+    GUI_VALUE( 50, 8 + 24 * 1, TFT_RED,   machine_position[0], 7, 2, 0, FreeMonoBold12pt7b),
+    GUI_VALUE( 50, 8 + 24 * 2, TFT_GREEN, machine_position[1], 7, 2, 0, FreeMonoBold12pt7b),
+    GUI_VALUE( 50, 8 + 24 * 3, TFT_BLUE,  machine_position[2], 7, 2, 0, FreeMonoBold12pt7b),
+
+    GUI_VALUE(162, 8 + 24 * 1, TFT_RED,   work_position[0], 7, 2, 0, FreeMonoBold12pt7b),
+    GUI_VALUE(162, 8 + 24 * 2, TFT_GREEN, work_position[1], 7, 2, 0, FreeMonoBold12pt7b),
+    GUI_VALUE(162, 8 + 24 * 3, TFT_BLUE,  work_position[2], 7, 2, 0, FreeMonoBold12pt7b)
 };
 
 const uint8_t button_up[] = {0, 0, 127, 254, 64, 2, 65, 130, 67, 194, 71, 226, 79, 242, 65, 130, 65, 130, 65, 130, 65, 130, 65, 130, 65, 130, 64, 2, 127, 254, 0, 0};
@@ -31,8 +43,8 @@ const uint8_t button_left[] = {0, 0, 127, 254, 64, 2, 64, 2, 66, 2, 70, 2, 78, 2
 const uint8_t button_right[] = {0, 0, 127, 254, 64, 2, 64, 2, 64, 66, 64, 98, 64, 114, 95, 250, 95, 250, 64, 114, 64, 98, 64, 66, 64, 2, 64, 2, 127, 254, 0, 0};
 
 GuiElement control_box_rates_children[] = {
-    GUI_BUTTON(0, 0, 120, 24, TFT_YELLOW, TFT_BLACK, "Step: 1.00mm", FreeSans9pt7b, 0),
-    GUI_BUTTON(148, 0, 120, 24, TFT_YELLOW, TFT_BLACK, "Feed: 100mm/s", FreeSans9pt7b, 0)
+    GUI_BUTTON(0, 0, 120, 24, TFT_YELLOW, TFT_BLACK, "Step: 1.00mm", ALIGN_CENTER, FreeSans9pt7b, 0),
+    GUI_BUTTON(148, 0, 120, 24, TFT_YELLOW, TFT_BLACK, "Feed: 100mm/s", ALIGN_CENTER, FreeSans9pt7b, 0)
 };
 
 GuiElement control_box_children[] = {
@@ -63,24 +75,28 @@ GuiElement me_children[] = {
 
     GUI_BOX_STATIC(16, 336, PARENT_WIDTH(-32), 33, TFT_BLACK, alarm_box_children),
 
-    GUI_BUTTON( 16, 440, 80, 24, TFT_BLUE, TFT_WHITE, "[Zero]", FreeSans9pt7b, 0),
-    GUI_BUTTON(120, 440, 80, 24, TFT_BLUE, TFT_WHITE, "[Menu]", FreeSans9pt7b, 0),
-    GUI_BUTTON(224, 440, 80, 24, TFT_BLUE, TFT_WHITE, "[Home]", FreeSans9pt7b, 0)
+    GUI_BUTTON( 16, 440, 80, 24, TFT_BLUE, TFT_WHITE, "[Zero]", ALIGN_CENTER, FreeSans9pt7b, 0),
+    GUI_BUTTON(120, 440, 80, 24, TFT_BLUE, TFT_WHITE, "[Menu]", ALIGN_CENTER, FreeSans9pt7b, 0),
+    GUI_BUTTON(224, 440, 80, 24, TFT_BLUE, TFT_WHITE, "[Home]", ALIGN_CENTER, FreeSans9pt7b, 0)
 };
 
-const GuiElement main_element = GUI_BOX_STATIC(0, 0, 320, 480, TFT_BLACK, me_children);
+GuiElement main_element = GUI_BOX_STATIC(0, 0, 320, 480, TFT_BLACK, me_children);
 
 uint32_t prevUpdate = 0;
 
+GfxDisplayList display;
+GfxScheduler scheduler;
+
 void setup() {
     Serial.begin(9600);
 
     tft_driver_init();
 
-    auto result = gfx_create_render_chain(&main_element, 1);
-    tft_submit_multiple(result.grc_operations, result.grc_length);
+    display = gfx_compile_display_list(&main_element, 1);
+    gfx_display_list_submit(&display);
 
-    gfx_activate_event_list(result.grc_eventList);
+    gfx_activate_event_list(display.gdl_eventList);
+    gfx_scheduler_init(&scheduler, &display, 30);
 
     tft_start_render();
 
@@ -89,13 +105,8 @@ void setup() {
     prevUpdate = millis();
 }
 
-GfxRenderChain chain;
 bool state = false;
 
-extern "C" void tft_render_finished() {
-    gfx_delete_render_chain(chain);
-}
-
 void loop() {
     tft_main_loop();
 
@@ -109,12 +120,12 @@ void loop() {
             me_children[3].ge_color = TFT_BLACK;
             state = false;
         }
-        me_children[3].ge_dirty = true;
 
-        chain = gfx_create_update_chain(&main_element, 1);
-        tft_submit_multiple(chain.grc_operations, chain.grc_length);
-        tft_start_render();
+        gfx_scheduler_invalidate(&scheduler, &me_children[3]);
 
         prevUpdate = millis();
     }
+
+    // Position values are polled on every frame
+    gfx_scheduler_poll(&scheduler, millis());
 }
@@ -0,0 +1,183 @@
+#include <unity.h>
+#include <math.h>
+
+#include "tft_color.h"
+
+// Largest allowed difference from the float reference in channel steps (red, green, blue)
+static const int SCALE_MAX_ERROR[3] = { 0, 0, 0 };
+static const int BLEND_A8_MAX_ERROR[3] = { 1, 1, 1 };
+// 5 bit factor rounded down, green has one bit more than the factor can resolve
+static const int BLEND_A4_MAX_ERROR[3] = { 1, 2, 1 };
+
+#define COLOR_COUNT 24
+
+static uint16_t colors[COLOR_COUNT];
+
+void setUp() {
+    // Extremes of every channel, the rest comes from a fixed LCG sequence
+    const uint16_t fixed[] = { 0x0000, 0xFFFF, 0x001F, 0x07E0, 0xF800, 0x0820, 0xF7DF, 0x8410 };
+    uint32_t seed = 12345;
+
+    for(size_t i = 0; i < COLOR_COUNT; ++i) {
+        seed = seed * 1103515245 + 12345;
+        colors[i] = i < sizeof(fixed) / sizeof(fixed[0]) ? fixed[i] : (uint16_t)(seed >> 16);
+    }
+}
+
+void tearDown() {}
+
+static int channel(uint16_t word, int index) {
+    switch(index) {
+        case 0: return word & 0x1F;
+        case 1: return (word >> 5) & 0x3F;
+        default: return word >> 11;
+    }
+}
+
+static void check_color(uint16_t result, const float expected[3], const int maxError[3]) {
+    for(int c = 0; c < 3; ++c)
+        TEST_ASSERT_INT_WITHIN(maxError[c], lroundf(expected[c]), channel(result, c));
+}
+
+static void reference_blend(uint16_t fg, uint16_t bg, float alpha, float out[3]) {
+    for(int c = 0; c < 3; ++c)
+        out[c] = channel(fg, c) * alpha + channel(bg, c) * (1.0f - alpha);
+}
+
+static void reference_scale(uint16_t color, uint16_t factor, float out[3]) {
+    // Scaling rounds down
+    for(int c = 0; c < 3; ++c)
+        out[c] = floorf(channel(color, c) * factor / 256.0f);
+}
+
+void test_color_scale() {
+    float expected[3];
+    for(size_t i = 0; i < COLOR_COUNT; ++i) {
+        for(uint16_t factor = 0; factor <= 256; ++factor) {
+            LcdColor color = { colors[i] };
+            reference_scale(colors[i], factor, expected);
+            check_color(tft_color_scale(color, factor).word, expected, SCALE_MAX_ERROR);
+        }
+    }
+}
+
+void test_scale2() {
+    float expected[3];
+    for(size_t i = 0; i < COLOR_COUNT; ++i) {
+        const uint16_t other = colors[COLOR_COUNT - 1 - i];
+        for(uint16_t factor = 0; factor <= 256; ++factor) {
+            const uint32_t pair = tft_scale2(colors[i] | ((uint32_t)other << 16), factor);
+            reference_scale(colors[i], factor, expected);
+            check_color(pair, expected, SCALE_MAX_ERROR);
+            reference_scale(other, factor, expected);
+            check_color(pair >> 16, expected, SCALE_MAX_ERROR);
+        }
+    }
+}
+
+void test_blend_a8() {
+    float expected[3];
+    for(size_t i = 0; i < COLOR_COUNT; ++i) {
+        for(size_t j = 0; j < COLOR_COUNT; ++j) {
+            LcdColor fg = { colors[i] };
+            LcdColor bg = { colors[j] };
+            for(int alpha = 0; alpha < 256; ++alpha) {
+                reference_blend(colors[i], colors[j], alpha / 255.0f, expected);
+                check_color(tft_blend_a8(fg, bg, alpha).word, expected, BLEND_A8_MAX_ERROR);
+            }
+
+            // Both ends are exact
+            TEST_ASSERT_EQUAL_HEX16(colors[j], tft_blend_a8(fg, bg, 0).word);
+            TEST_ASSERT_EQUAL_HEX16(colors[i], tft_blend_a8(fg, bg, 255).word);
+        }
+    }
+}
+
+void test_blend_a4() {
+    float expected[3];
+    for(size_t i = 0; i < COLOR_COUNT; ++i) {
+        for(size_t j = 0; j < COLOR_COUNT; ++j) {
+            LcdColor fg = { colors[i] };
+            LcdColor bg = { colors[j] };
+            for(int alpha = 0; alpha < 16; ++alpha) {
+                reference_blend(colors[i], colors[j], alpha / 15.0f, expected);
+                check_color(tft_blend_a4(fg, bg, alpha).word, expected, BLEND_A4_MAX_ERROR);
+            }
+
+            TEST_ASSERT_EQUAL_HEX16(colors[j], tft_blend_a4(fg, bg, 0).word);
+            TEST_ASSERT_EQUAL_HEX16(colors[i], tft_blend_a4(fg, bg, 15).word);
+        }
+    }
+}
+
+void test_color_lerp() {
+    float expected[3];
+    for(size_t i = 0; i < COLOR_COUNT; ++i) {
+        for(size_t j = 0; j < COLOR_COUNT; ++j) {
+            LcdColor from = { colors[i] };
+            LcdColor to = { colors[j] };
+            for(int t = 0; t < 256; ++t) {
+                reference_blend(colors[j], colors[i], t / 255.0f, expected);
+                check_color(tft_color_lerp(from, to, t).word, expected, BLEND_A8_MAX_ERROR);
+            }
+        }
+    }
+}
+
+void test_blend2_a8() {
+    float expected[3];
+    for(size_t i = 0; i < COLOR_COUNT; ++i) {
+        for(size_t j = 0; j < COLOR_COUNT; ++j) {
+            // The second pixel of the pair blends different colors
+            const uint16_t fg2 = colors[j];
+            const uint16_t bg2 = colors[i];
+            const uint32_t fg = colors[i] | ((uint32_t)fg2 << 16);
+            const uint32_t bg = colors[j] | ((uint32_t)bg2 << 16);
+
+            for(int alpha = 0; alpha < 256; ++alpha) {
+                const uint32_t pair = tft_blend2_a8(fg, bg, alpha);
+                reference_blend(colors[i], colors[j], alpha / 255.0f, expected);
+                check_color(pair, expected, BLEND_A8_MAX_ERROR);
+                reference_blend(fg2, bg2, alpha / 255.0f, expected);
+                check_color(pair >> 16, expected, BLEND_A8_MAX_ERROR);
+            }
+        }
+    }
+}
+
+void test_color_bitfields() {
+    // The bitfield view has to agree with TFT_COLOR
+    LcdColor color = TFT_COLOR(0x15, 0x0A, 0x1C);
+    TEST_ASSERT_EQUAL_INT(0x15, color.r);
+    TEST_ASSERT_EQUAL_INT(0x0A, color.g);
+    TEST_ASSERT_EQUAL_INT(0x1C, color.b);
+    TEST_ASSERT_EQUAL_INT(0, color.zero);
+}
+
+int run_tests() {
+    UNITY_BEGIN();
+    RUN_TEST(test_color_scale);
+    RUN_TEST(test_scale2);
+    RUN_TEST(test_blend_a8);
+    RUN_TEST(test_blend_a4);
+    RUN_TEST(test_color_lerp);
+    RUN_TEST(test_blend2_a8);
+    RUN_TEST(test_color_bitfields);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup() {
+    // Give the serial monitor time to connect
+    delay(2000);
+    run_tests();
+}
+
+void loop() {}
+#else
+int main() {
+    return run_tests();
+}
+#endif
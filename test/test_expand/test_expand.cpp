@@ -0,0 +1,94 @@
+#include <unity.h>
+
+#include "tft_expand.h"
+
+// Colors as (foreground, background), including equal and inverted pairs
+static const uint16_t colors[][2] = {
+    { 0xFFFF, 0x0000 },
+    { 0x0000, 0xFFFF },
+    { 0xF800, 0x07E0 },
+    { 0x001F, 0xF81F },
+    { 0x1234, 0xABCD },
+    { 0x8001, 0x7FFE },
+    { 0x5555, 0x5555 }
+};
+
+void setUp() {}
+
+void tearDown() {}
+
+typedef void kernel_t(uint16_t* out, uint8_t bits, uint32_t fgPair, uint32_t bgPair);
+
+// The per-bit loop the rasterizers used before the kernels
+static void reference_expand(uint16_t* out, uint8_t bits, uint16_t fg, uint16_t bg) {
+    for(int i = 0; i < 8; ++i)
+        out[i] = (bits & (0x80 >> i)) ? fg : bg;
+}
+
+static void check_kernel(kernel_t* kernel) {
+    uint16_t expected[8];
+    // One extra pixel in front, rows don't have to start on a word boundary
+    uint16_t buffer[10];
+
+    for(size_t c = 0; c < sizeof(colors) / sizeof(colors[0]); ++c) {
+        const uint16_t fg = colors[c][0];
+        const uint16_t bg = colors[c][1];
+
+        for(int bits = 0; bits < 256; ++bits) {
+            reference_expand(expected, bits, fg, bg);
+
+            for(int offset = 0; offset < 2; ++offset) {
+                memset(buffer, 0xA5, sizeof(buffer));
+                kernel(buffer + offset, bits, TFT_PIXEL_PAIR(fg), TFT_PIXEL_PAIR(bg));
+                TEST_ASSERT_EQUAL_HEX16_ARRAY(expected, buffer + offset, 8);
+                // Nothing is written past the eight pixels
+                TEST_ASSERT_EQUAL_HEX16(0xA5A5, buffer[offset + 8]);
+            }
+        }
+    }
+}
+
+void test_expand8_c() {
+    check_kernel(tft_expand8_c);
+}
+
+void test_expand8_lut() {
+    check_kernel(tft_expand8_lut);
+}
+
+void test_expand8_dsp() {
+#if defined(__ARM_FEATURE_SIMD32)
+    check_kernel(tft_expand8_dsp);
+#else
+    TEST_IGNORE_MESSAGE("No SIMD instructions on this target");
+#endif
+}
+
+void test_expand8_selected() {
+    check_kernel(tft_expand8);
+}
+
+int run_tests() {
+    UNITY_BEGIN();
+    RUN_TEST(test_expand8_c);
+    RUN_TEST(test_expand8_lut);
+    RUN_TEST(test_expand8_dsp);
+    RUN_TEST(test_expand8_selected);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+void setup() {
+    // Give the serial monitor time to connect
+    delay(2000);
+    run_tests();
+}
+
+void loop() {}
+#else
+int main() {
+    return run_tests();
+}
+#endif